@@ -0,0 +1,67 @@
+#ifndef A_DAMAGE_TRACKER_H // !A_DAMAGE_TRACKER_H
+#define A_DAMAGE_TRACKER_H
+
+#include <imgui/imgui.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace android
+{
+    class ADamageTracker
+    {
+    public:
+        // Framebuffer space rectangle, origin at the top left corner.
+        struct Rect
+        {
+            int32_t left = 0;
+            int32_t top = 0;
+            int32_t right = 0;
+            int32_t bottom = 0;
+
+            bool IsEmpty() const
+            {
+                return right <= left || bottom <= top;
+            }
+
+            bool Contains(const Rect &other) const
+            {
+                return left <= other.left && top <= other.top && right >= other.right && bottom >= other.bottom;
+            }
+
+            Rect Union(const Rect &other) const;
+            Rect Intersect(const Rect &other) const;
+        };
+
+    public:
+        /**
+         * Diff the draw lists of drawData against the previous frame and return the region
+         * of the back buffer that must be repainted. bufferAge is the EGL buffer age of the
+         * back buffer, 0 means unknown and forces a full repaint.
+         */
+        Rect Update(const ImDrawData *drawData, int bufferAge);
+
+        // Forget the damage history, the next update repaints the whole framebuffer.
+        void Invalidate();
+
+        // Clip every draw command of drawData to the repaint region.
+        static void ClipDrawData(ImDrawData *drawData, const Rect &repaintRect);
+
+    private:
+        static constexpr size_t MaxHistory = 4;
+
+        struct DrawListState
+        {
+            uint64_t hash;
+            Rect bounds;
+        };
+
+        std::vector<DrawListState> m_previousLists, m_currentLists;
+        std::array<Rect, MaxHistory> m_history{};
+        size_t m_historyCount = 0;
+        Rect m_framebufferRect{};
+    };
+}
+
+#endif // !A_DAMAGE_TRACKER_H
@@ -0,0 +1,190 @@
+#ifndef A_FRAME_PROFILER_H // !A_FRAME_PROFILER_H
+#define A_FRAME_PROFILER_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace android
+{
+    /**
+     * Rolling per-phase frame timings. Every phase owns a ring of the latest samples, producers
+     * store into it with relaxed atomics and readers copy it without locking, so a reader may see
+     * a sample of the frame being written. The GPU timer wraps GL_EXT_disjoint_timer_query and
+     * has to be used from the thread owning the GL context.
+     */
+    class AFrameProfiler
+    {
+    public:
+        enum class Phase
+        {
+            BeginFrame, // Whole BeginFrame
+            DisplayPoll,
+            MirrorProcess,
+            NewFrame,
+            UserCode, // From the end of BeginFrame to the start of EndFrame
+            Render,   // ImGui::Render
+            Serialize,
+            Compress,
+            Send,
+            Receive,
+            Decompress,
+            Parse,
+            Submit, // GL command submission of the renderer
+            Gpu,    // GPU execution of the submitted commands
+            Swap,
+            Count,
+        };
+
+        enum class Counter
+        {
+            FrameTime,        // Milliseconds between two EndFrame calls
+            FrameBytes,       // Bytes sent or received per frame over rpc, uploaded geometry when rendering natively
+            CompressionRatio, // Uncompressed over compressed frame size
+            DrawCalls,
+            InputLatency, // Milliseconds from the kernel timestamp of an input to the frame using it being presented
+            Count,
+        };
+
+        struct Statistics
+        {
+            size_t sampleCount;
+            float last;
+            float average;
+            float p50, p95, p99;
+        };
+
+        class ScopedTimer
+        {
+        public:
+            ScopedTimer(AFrameProfiler &profiler, Phase phase)
+                : m_profiler(profiler), m_phase(phase), m_start(std::chrono::steady_clock::now())
+            {
+            }
+            ~ScopedTimer()
+            {
+                m_profiler.Record(m_phase, m_start);
+            }
+
+            ScopedTimer(const ScopedTimer &) = delete;
+            ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        private:
+            AFrameProfiler &m_profiler;
+            Phase m_phase;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        // Input latency histogram, the last bucket also counts everything above it
+        struct LatencyHistogram
+        {
+            static constexpr size_t BucketCount = 32;
+            static constexpr float BucketMilliseconds = 4.f;
+
+            std::array<uint64_t, BucketCount> counts;
+            uint64_t totalCount;
+        };
+
+        static constexpr size_t SampleCount = 256;
+        static constexpr size_t PhaseCount = static_cast<size_t>(Phase::Count);
+        static constexpr size_t CounterCount = static_cast<size_t>(Counter::Count);
+
+    public:
+        static const char *GetPhaseName(Phase phase);
+        static const char *GetCounterName(Counter counter);
+
+        void Record(Phase phase, float milliseconds);
+        void Record(Phase phase, std::chrono::steady_clock::time_point start);
+        void Record(Counter counter, float value);
+
+        // Copy up to maxCount of the newest samples of phase into samples, oldest first.
+        size_t ReadSamples(Phase phase, float *samples, size_t maxCount) const;
+        size_t ReadSamples(Counter counter, float *samples, size_t maxCount) const;
+        Statistics GetStatistics(Phase phase) const;
+        Statistics GetStatistics(Counter counter) const;
+        void Reset();
+
+        // Frames produced but replaced or skipped before they reached the screen.
+        void AddDroppedFrame();
+        uint64_t GetDroppedFrames() const;
+
+        // Timestamps are CLOCK_MONOTONIC nanoseconds, the evdev clock. The oldest input consumed since
+        // the last present starts the latency measurement and the next present ends it.
+        void MarkInput(int64_t eventNanoseconds);
+        // Hand the pending input over to another process presenting the frame, 0 when there is none.
+        int64_t TakeInput();
+        // Around eglSwapBuffers, the display present time replaces the swap time once EGL reports it.
+        void BeginPresent();
+        void MarkPresent();
+        LatencyHistogram GetInputLatencyHistogram() const;
+
+        bool InitGpuTimer();
+        void ShutdownGpuTimer();
+        void BeginGpuTimer();
+        void EndGpuTimer();
+
+        // Needs EGL_ANDROID_get_frame_timestamps, without it latency ends when eglSwapBuffers returns.
+        bool InitPresentTimer(EGLDisplay display, EGLSurface surface);
+        void ShutdownPresentTimer();
+
+    private:
+        static constexpr size_t GpuQueryCount = 4;
+        static constexpr size_t PresentQueryCount = 8;
+
+        struct PendingPresent
+        {
+            bool pending;
+            EGLuint64KHR frameId;
+            int64_t inputNanoseconds;
+            int64_t swapNanoseconds;
+        };
+
+        struct Series
+        {
+            std::atomic<uint64_t> writeCount{0};
+            std::array<std::atomic<float>, SampleCount> samples{};
+        };
+
+        void RecordSeries(size_t series, float value);
+        size_t ReadSeries(size_t series, float *samples, size_t maxCount) const;
+        Statistics GetSeriesStatistics(size_t series) const;
+        void CollectGpuTimers();
+        void CollectPresentTimes();
+        void RecordInputLatency(int64_t nanoseconds);
+
+    private:
+        // Phases first, counters after them
+        std::array<Series, PhaseCount + CounterCount> m_series{};
+        std::atomic<uint64_t> m_droppedFrames{0};
+        std::atomic<int64_t> m_inputNanoseconds{0};
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BucketCount> m_latencyBuckets{};
+
+        // Queries are read back a few frames later so that collecting them never stalls the pipeline
+        bool m_gpuTimerSupported = false;
+        std::array<GLuint, GpuQueryCount> m_gpuQueries{};
+        std::array<bool, GpuQueryCount> m_gpuQueryPending{};
+        size_t m_gpuQueryIndex = 0;
+        bool m_gpuQueryActive = false;
+        PFNGLGETQUERYOBJECTUI64VEXTPROC m_glGetQueryObjectui64v = nullptr;
+
+        // Present times arrive a few frames after the swap, frames wait here until then
+        bool m_presentTimerSupported = false;
+        EGLDisplay m_presentDisplay = EGL_NO_DISPLAY;
+        EGLSurface m_presentSurface = EGL_NO_SURFACE;
+        std::array<PendingPresent, PresentQueryCount> m_pendingPresents{};
+        size_t m_pendingPresentIndex = 0;
+        bool m_nextFrameIdValid = false;
+        EGLuint64KHR m_nextFrameId = 0;
+        PFNEGLGETNEXTFRAMEIDANDROIDPROC m_eglGetNextFrameId = nullptr;
+        PFNEGLGETFRAMETIMESTAMPSANDROIDPROC m_eglGetFrameTimestamps = nullptr;
+    };
+}
+
+#endif // !A_FRAME_PROFILER_H
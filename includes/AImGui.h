@@ -3,9 +3,9 @@
 
 #include <imgui/imgui.h>
 #include <imgui/backends/imgui_impl_android.h>
-#include <imgui/backends/imgui_impl_opengl3.h>
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES3/gl3.h>
 #include <sys/socket.h>
 #include <poll.h>
@@ -15,6 +15,8 @@
 #include <linux/time.h>
 
 #include <thread>
+#include <chrono>
+#include <array>
 #include <memory>
 #include <vector>
 #include <string>
@@ -22,6 +24,12 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "ADamageTracker.h"
+#include "AFrameProfiler.h"
+#include "AInputQueue.h"
+#include "ATouchResampler.h"
+#include "AOpenGLES3Renderer.h"
+
 namespace android
 {
     class AImGui
@@ -34,6 +42,13 @@ namespace android
             RenderClient,
         };
 
+        enum class SurfaceFormat
+        {
+            RGBA8888,
+            RGBA4444,
+            RGB565, // Opaque, for panels that fill their whole surface
+        };
+
         enum class RenderState
         {
             SetFont,
@@ -49,6 +64,27 @@ namespace android
             bool exchangeFontData = false;
             std::string serverListenAddress = "127.0.0.1";
             std::string clientConnectAddress = "127.0.0.1";
+            bool partialRedraw = true; // Only repaint the damaged region of the surface when EGL allows it
+            bool trackVirtualDisplays = true; // Also mirror onto virtual displays (recording, casting), found by running dumpsys every few seconds
+            bool autoFit = false;      // Shrink the surface to the bounding box of the drawn ui instead of covering the whole display
+            float renderScale = 1.f;   // Render at a fraction of the display resolution, SurfaceFlinger upscales the layer
+            SurfaceFormat surfaceFormat = SurfaceFormat::RGBA8888;
+            bool autoHideSurface = true; // Hide the surface and stop swapping while nothing is drawn
+            bool threadedRendering = false; // RenderNative only: submit and swap on a dedicated thread owning the EGL context
+            std::string programCacheDirectory = "/data/local/tmp"; // Linked shader binaries are kept here, empty disables it
+            bool performanceOverlay = false; // Show the performance window from the start, Ctrl+Shift+P toggles it
+            bool touchResampling = true; // Drag the pointer to where the finger is expected when the frame is presented
+            ATouchResampler::Options touchResampler{};
+            std::string inputRecordPath;   // Record the raw input events to this file, see ATouchEvent::StartRecording
+            std::string inputReplayPath;   // Replay a recording instead of reading /dev/input
+            float inputReplaySpeed = 1.f; // Replay faster than recorded when above 1
+        };
+
+        struct StartupPhase
+        {
+            const char *name;
+            float startMilliseconds; // Offset from the start of initialization, phases run concurrently may overlap
+            float durationMilliseconds;
         };
 
     public:
@@ -61,11 +97,36 @@ namespace android
         void BeginFrame();
         void EndFrame();
 
+        // Non blocking, handles at most one input event.
         void ProcessInputEvent();
+        // Call from a single input thread, events are queued and reach ImGui in the next BeginFrame.
+        // Sleep until one input event is handled, the timeout elapses or InterruptInputEvent is called.
+        // A negative timeout waits forever, returns whether an event was handled.
+        bool WaitInputEvent(int timeoutMilliseconds = -1);
+        void InterruptInputEvent();
 
         void SetupWindowInfo(void *windowInfo);
 
-        constexpr operator bool() const
+        std::vector<StartupPhase> GetStartupPhases() const;
+        float GetStartupMilliseconds() const;
+        float GetFirstFrameMilliseconds() const; // Negative until the first EndFrame
+
+        AFrameProfiler &GetFrameProfiler()
+        {
+            return m_frameProfiler;
+        }
+
+        // The overlay only reads the profiler counters, they are recorded whether it is shown or not.
+        void SetPerformanceOverlayVisible(bool visible)
+        {
+            m_performanceOverlayVisible = visible;
+        }
+        bool IsPerformanceOverlayVisible() const
+        {
+            return m_performanceOverlayVisible;
+        }
+
+        operator bool() const
         {
             return m_state;
         }
@@ -73,14 +134,41 @@ namespace android
     private:
         bool InitEnvironment();
         void UnInitEnvironment();
+        void ResizeEnvironment(int theta, int width, int height);
+        void ResizeSurface(int width, int height);
+
+        void PresentDrawData(ImDrawData *drawData, int screenWidth, int screenHeight);
+        void FitSurfaceToDrawData(ImDrawData *drawData, int screenWidth, int screenHeight);
+        void RecordPresentCounters(const ImDrawData *drawData);
+        void MarkFrameSwapped();
+        void PaceSkippedFrame();
+
+        void SubmitDrawData(const ImDrawData *drawData);
+        void RenderWorker();
+
+        void DrawPerformanceOverlay();
 
         void ServerWorker();
 
+        void DispatchInputEvents();
+        void ApplyPinchZoom();
+
+        void RecordStartupPhase(const char *name, std::chrono::steady_clock::time_point phaseStart);
+
         int ReadData(void *buffer, size_t readSize);
         void WriteData(void *data, size_t size);
 
     private:
-        bool m_state = false;
+        struct FrameSnapshot
+        {
+            ImDrawData drawData;
+            ImVector<ImDrawList *> drawLists;
+            int screenWidth, screenHeight;
+        };
+
+    private:
+        std::atomic<bool> m_state = false; // Cleared by the render and server threads when they fail
+        bool m_displayWatcherStarted = false;
 
         int m_rotateTheta = 0;
         int m_screenWidth = -1, m_screenHeight = -1;
@@ -100,6 +188,53 @@ namespace android
         EGLSurface m_eglSurface = EGL_NO_SURFACE;
         EGLContext m_eglContext = EGL_NO_CONTEXT;
         ImGuiContext *m_imguiContext = nullptr;
+        AOpenGLES3Renderer m_renderer;
+
+        bool m_eglBufferAgeSupported = false;
+        PFNEGLSETDAMAGEREGIONKHRPROC m_eglSetDamageRegion = nullptr;
+        PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC m_eglSwapBuffersWithDamage = nullptr;
+        ADamageTracker m_damageTracker;
+
+        bool m_surfaceHidden = false;
+        // Frames that skip eglSwapBuffers are not held back by vsync, they wait one measured swap interval instead
+        std::chrono::steady_clock::time_point m_lastFrameSwap{};
+        std::chrono::nanoseconds m_frameSwapInterval = std::chrono::nanoseconds(16666667);
+        ADamageTracker::Rect m_fitRect{};
+        int m_fitShrinkFrames = 0;
+
+        // Triple buffered frames handed from EndFrame to the render thread, the newest ready frame wins
+        std::unique_ptr<std::thread> m_renderThread;
+        std::mutex m_frameMutex;
+        std::condition_variable m_frameCondition;
+        std::array<FrameSnapshot, 3> m_frames{};
+        size_t m_writeFrame = 0, m_readyFrame = 1, m_renderFrame = 2;
+        bool m_frameReady = false;
+        bool m_renderThreadRunning = false;
+
+        // Phases are recorded from the initialization tasks as well, guarded by m_startupMutex
+        mutable std::mutex m_startupMutex;
+        std::chrono::steady_clock::time_point m_startupStart{};
+        std::vector<StartupPhase> m_startupPhases;
+        float m_startupMilliseconds = 0.f;
+        float m_firstFrameMilliseconds = -1.f;
+
+        // Input devices for the native and server modes, the client wakes its socket wait through m_inputWakeFd
+        std::unique_ptr<ATouchEvent> m_touchEvent;
+        int m_inputWakeFd = -1;
+        // Filled by the input thread, drained into ImGuiIO by BeginFrame
+        AInputQueue m_inputQueue;
+        bool m_inputShiftDown = false;
+        bool m_inputCtrlDown = false;
+        float m_pinchScale = 1.f; // Pinch gestures of the frame, multiplied together
+        ATouchResampler m_touchResampler;
+        bool m_touchPointerDown = false;
+        bool m_touchPointerPredicted = false; // The pointer shows a resampled position, not a reported one
+
+        AFrameProfiler m_frameProfiler;
+        std::chrono::steady_clock::time_point m_userCodeStart{};
+        std::chrono::steady_clock::time_point m_lastEndFrame{};
+        bool m_performanceOverlayVisible = false;
+        int64_t m_serverInputNanoseconds = 0;
     };
 } // namespace android
 
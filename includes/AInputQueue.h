@@ -0,0 +1,54 @@
+#ifndef A_INPUT_QUEUE_H // !A_INPUT_QUEUE_H
+#define A_INPUT_QUEUE_H
+
+#include "ATouchEvent.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace android
+{
+    /**
+     * Bounded single producer single consumer ring of input events. The input thread pushes
+     * without locking or waiting, the ui thread drains it before NewFrame so the ImGui context
+     * is only touched by the thread owning it.
+     */
+    class AInputQueue
+    {
+    public:
+        static constexpr size_t Capacity = 256; // Power of two
+
+        struct Entry
+        {
+            ATouchEvent::TouchEvent event;
+            int64_t oldestNanoseconds;              // Timestamp of the first move collapsed into event, its own otherwise
+            ATouchEvent::TouchEvent previousMove{}; // Move collapsed right before event, valid when moveCount > 1
+            size_t moveCount = 0;                   // Moves collapsed into event
+        };
+
+    public:
+        // Producer side, the event is dropped when the queue is full.
+        bool Push(const ATouchEvent::TouchEvent &event);
+        // Consumer side, copies up to maxCount events oldest first. A run of moves collapses into its last one,
+        // the one before it is kept so that a touch resampler still gets two samples per frame.
+        size_t Drain(Entry *entries, size_t maxCount);
+
+        uint64_t GetDroppedCount() const
+        {
+            return m_droppedCount.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static_assert(0 == (Capacity & (Capacity - 1)));
+
+        // Indices only grow, each one is written by a single side
+        alignas(64) std::atomic<size_t> m_readIndex{0};
+        alignas(64) std::atomic<size_t> m_writeIndex{0};
+        std::atomic<uint64_t> m_droppedCount{0};
+        std::array<ATouchEvent::TouchEvent, Capacity> m_events{};
+    };
+}
+
+#endif // !A_INPUT_QUEUE_H
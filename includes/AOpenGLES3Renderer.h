@@ -0,0 +1,84 @@
+#ifndef A_OPENGLES3_RENDERER_H // !A_OPENGLES3_RENDERER_H
+#define A_OPENGLES3_RENDERER_H
+
+#include <imgui/imgui.h>
+
+#include <GLES3/gl3.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace android
+{
+    /**
+     * ImGui renderer for a GLES3 context owned exclusively by AImGui. Each frame is uploaded
+     * with one mapped copy into a ring of vertex/index buffers guarded by fences, indices are
+     * rebased to 32 bits so a frame binds one VAO, and adjacent commands sharing texture and
+     * clip rectangle are drawn together. GL state is set but never backed up or restored.
+     */
+    class AOpenGLES3Renderer
+    {
+    public:
+        ~AOpenGLES3Renderer();
+
+        // programCacheDirectory keeps linked program binaries between runs, empty disables the cache.
+        bool Init(const std::string &programCacheDirectory = {});
+        void Shutdown();
+
+        bool CreateFontsTexture();
+        void DestroyFontsTexture();
+
+        void RenderDrawData(ImDrawData *drawData);
+
+        size_t GetDrawCallCount() const
+        {
+            return m_drawCallCount;
+        }
+
+    private:
+        static constexpr size_t RingSize = 3;
+
+        struct FrameBuffers
+        {
+            GLuint vertexArray = 0;
+            GLuint vertexBuffer = 0;
+            GLuint indexBuffer = 0;
+            GLsizeiptr vertexBufferSize = 0;
+            GLsizeiptr indexBufferSize = 0;
+            GLsync fence = nullptr;
+        };
+
+        struct DrawCommand
+        {
+            GLint scissor[4];
+            GLuint texture;
+            GLsizei indexOffset;
+            GLsizei indexCount;
+        };
+
+        bool CreateProgram(const std::string &programCacheDirectory);
+        bool CompileProgram();
+        bool LoadProgramBinary(const std::string &cachePath);
+        void SaveProgramBinary(const std::string &cachePath);
+        bool UploadDrawData(FrameBuffers &frameBuffers, const ImDrawData *drawData, bool buffersIdle);
+        void SetupRenderState(const ImDrawData *drawData, int framebufferWidth, int framebufferHeight);
+        void Draw(const DrawCommand &command);
+
+    private:
+        bool m_initialized = false;
+
+        GLuint m_program = 0;
+        GLint m_projectionLocation = -1;
+        GLint m_textureLocation = -1;
+        GLuint m_fontTexture = 0;
+        GLuint m_boundTexture = 0;
+
+        std::array<FrameBuffers, RingSize> m_frameBuffers{};
+        size_t m_frameIndex = 0;
+        size_t m_drawCallCount = 0; // Of the last RenderDrawData
+    };
+}
+
+#endif // !A_OPENGLES3_RENDERER_H
@@ -3,12 +3,22 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <linux/input.h>
 #include <android/keycodes.h>
 
 #include <array>
+#include <atomic>
 #include <bitset>
+#include <condition_variable>
+#include <cstdio>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace android
@@ -67,6 +77,8 @@ namespace android
             KeyDown,
             KeyUp,
             Wheel,
+            Scroll, // Two finger drag, deltaX and deltaY in touch panel units
+            Pinch,  // Two finger zoom, scale is the finger distance over the one of the previous pinch event
         };
 
         struct TouchEvent
@@ -76,14 +88,21 @@ namespace android
             int y;
             int scanCode;
             int keyCode;
+            float deltaX;
+            float deltaY;
+            float scale;
+            int64_t timestampNanoseconds; // Kernel CLOCK_MONOTONIC time of the report
 
             void TransformToScreen(int width, int height, int theta = 0)
             {
                 auto k = x, l = width;
+                auto deltaK = deltaX;
                 if (90 == theta)
                 {
                     x = y;
                     y = transformScalerX - k;
+                    deltaX = deltaY;
+                    deltaY = -deltaK;
                     width = height;
                     height = l;
                 }
@@ -91,36 +110,164 @@ namespace android
                 {
                     x = transformScalerX - x;
                     y = transformScalerY - y;
+                    deltaX = -deltaX;
+                    deltaY = -deltaY;
                 }
                 else if (270 == theta)
                 {
                     x = transformScalerY - y;
                     y = k;
+                    deltaX = -deltaY;
+                    deltaY = deltaK;
                     width = height;
                     height = l;
                 }
 
                 x = x * width / transformScalerX;
                 y = y * height / transformScalerY;
+                deltaX = deltaX * width / transformScalerX;
+                deltaY = deltaY * height / transformScalerY;
             }
         };
 
+        enum DeviceClass : uint32_t
+        {
+            DeviceClassTouch = 1 << 0,
+            DeviceClassKeyboard = 1 << 1,
+            DeviceClassMouse = 1 << 2,
+        };
+
     public:
+        /**
+         * Opens every touch screen, keyboard and mouse under /dev/input and multiplexes them
+         * with one epoll set, devices plugged in or removed later are picked up through inotify.
+         * GetTouchEvent never blocks, WaitTouchEvent sleeps in epoll until a report completes.
+         * Touch screens are tracked with the multi touch protocol B, the first finger drives the
+         * pointer and a second one turns the contact into a scroll or pinch gesture.
+         */
         ATouchEvent();
+        /**
+         * Replays a file written by StartRecording instead of opening /dev/input. Every recorded
+         * device becomes a pipe fed by a thread at the recorded pace divided by replaySpeed, so
+         * the events go through the same path as live ones.
+         */
+        ATouchEvent(const std::string &replayPath, float replaySpeed = 1.f);
         ~ATouchEvent();
 
+        // Dump every raw event read from now on, with the devices and their ranges, to path.
+        // Call from the thread reading the events.
+        bool StartRecording(const std::string &path);
+        void StopRecording();
+
         bool GetRawEvent(input_event *event);
 
         bool GetTouchEvent(TouchEvent *touchEvent);
+        // Negative timeout waits forever, returns false on timeout or Interrupt.
+        bool WaitTouchEvent(TouchEvent *touchEvent, int timeoutMilliseconds);
+        // Wake a thread blocked in WaitTouchEvent, safe to call from any thread.
+        void Interrupt();
+
+        // Assembled events lost to a full queue, reads are sized so that this stays at 0.
+        uint64_t GetDroppedCount() const
+        {
+            return m_droppedEventCount;
+        }
 
     public:
+        // Range of the x and y of touch events, taken from the first touch screen
         static int transformScalerX, transformScalerY;
 
     private:
-        int m_deviceFd = -1;
+        static constexpr size_t MaxPacketEvents = 64;  // A report longer than this is dropped like a SYN_DROPPED one
+        static constexpr size_t ReadBatchEvents = 64;  // input_event structures read per syscall
+        static constexpr size_t MaxQueuedEvents = 128; // Assembled events waiting for GetTouchEvent
+        static constexpr size_t MaxTouchSlots = 10;    // Contacts past this slot index are ignored
+        static_assert(MaxQueuedEvents > MaxPacketEvents, "A pending report must always fit in the queue");
+        // Recordings naming a device past this id are not replayed
+        static constexpr uint32_t MaxReplayDeviceId = 1024;
+
+        struct TouchSlot
+        {
+            int trackingId = -1; // -1 when no finger is on the slot
+            int x = 0, y = 0;
+        };
+
+        enum class GestureState
+        {
+            None,
+            Pending, // Two fingers down, waiting for them to move far enough to tell scroll from pinch
+            Scroll,
+            Pinch,
+            Ended, // A finger of the gesture lifted, nothing is reported until every finger does
+        };
+
+        struct Device
+        {
+            int fd = -1;
+            uint32_t id = 0; // Identifies the device in recordings
+            std::string path;
+            std::string name;
+            uint32_t classes = 0;
+            input_absinfo absX{}, absY{}; // ABS_MT_POSITION_X and ABS_MT_POSITION_Y of touch devices
+
+            // Events of the report not yet closed by SYN_REPORT
+            std::array<input_event, MaxPacketEvents> pendingEvents{};
+            size_t pendingEventCount = 0;
+            bool droppingPacket = false; // Discard everything up to the next SYN_REPORT
+            int64_t reportNanoseconds = 0;
+
+            std::array<TouchSlot, MaxTouchSlots> slots{};
+            int currentSlot = 0;        // -1 while the kernel reports a slot past MaxTouchSlots
+            bool hasTrackingId = false; // Without ABS_MT_TRACKING_ID slot 0 follows BTN_TOUCH
+            int primarySlot = -1;       // Slot driving the pointer
+            int primaryTrackingId = -1;
+            int lastTouchPointX = 0, lastTouchPointY = 0;
+
+            GestureState gestureState = GestureState::None;
+            int gestureSlots[2] = {-1, -1};
+            float gestureStartDistance = 0.f, gestureDistance = 0.f;
+            float gestureStartCenterX = 0.f, gestureStartCenterY = 0.f;
+            float gestureCenterX = 0.f, gestureCenterY = 0.f;
+        };
+
+        void InitEpoll();
+        void OpenDevice(const std::string &path);
+        void AddDevice(std::unique_ptr<Device> device);
+        void RecordDevice(const Device &device);
+        void RecordEvent(const Device &device, const input_event &event);
+        bool StartReplay(const std::string &path, float speed);
+        void ReplayWorker(float speed);
+        void CloseReplayPipes();
+        void CloseDevice(Device *device);
+        void ProcessHotplug();
+        void ReadDevice(Device *device);
+        void ProcessDeviceEvent(Device *device, const input_event &event);
+        void ProcessTouchSlots(Device *device);
+        void ProcessGesture(Device *device);
+        void PushTouchEvent(const TouchEvent &touchEvent);
+        bool PollDevices(int timeoutMilliseconds);
+
+    private:
+        int m_epollFd = -1;
+        int m_inotifyFd = -1;
+        int m_wakeFd = -1;
+        std::vector<std::unique_ptr<Device>> m_devices;
+
+        std::array<input_event, ReadBatchEvents> m_readBuffer{};
+        std::array<TouchEvent, MaxQueuedEvents> m_touchEvents{};
+        size_t m_touchEventIndex = 0, m_touchEventCount = 0;
+        uint64_t m_droppedEventCount = 0;
+        uint32_t m_nextDeviceId = 0;
+
+        FILE *m_recordFile = nullptr;
 
-        typename detail::BitArray<KEY_MAX>::Buffer m_keyBitBuffer;
-        detail::BitArray<KEY_MAX> m_keyBitmask;
+        // Write ends of the replay pipes indexed by recorded device id, -1 for ids not replayed
+        std::vector<int> m_replayFds;
+        std::vector<uint8_t> m_replayData;
+        std::unique_ptr<std::thread> m_replayThread;
+        std::mutex m_replayMutex;
+        std::condition_variable m_replayCondition;
+        bool m_replayStopping = false;
     };
 }
 
@@ -0,0 +1,55 @@
+#ifndef A_TOUCH_RESAMPLER_H // !A_TOUCH_RESAMPLER_H
+#define A_TOUCH_RESAMPLER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace android
+{
+    /**
+     * Moves the pointer of a drag to where the finger is at the frame's sample time, the way
+     * Android's InputConsumer resamples motion events. The touch panel reports at its own rate,
+     * the two newest samples are interpolated when the sample time falls between them and
+     * extrapolated, within the prediction limit, when it is past the newest one.
+     */
+    class ATouchResampler
+    {
+    public:
+        struct Options
+        {
+            float resampleLatencyMilliseconds = 5.f; // Sample this long before the target present time
+            float maxPredictionMilliseconds = 8.f;   // Never extrapolate further than this past the newest sample
+            float minDeltaMilliseconds = 2.f;        // Samples closer than this give a too noisy velocity
+            float maxDeltaMilliseconds = 20.f;       // Samples further apart than this are from a stalled finger
+        };
+
+    public:
+        ATouchResampler() = default;
+        explicit ATouchResampler(const Options &options)
+            : m_options(options)
+        {
+        }
+
+        // Timestamps are CLOCK_MONOTONIC nanoseconds, samples have to be added in time order.
+        void AddSample(int64_t timestampNanoseconds, float x, float y);
+        void Reset();
+
+        // Position at targetNanoseconds minus the resample latency, the newest sample when the
+        // history can not be resampled. Returns false without any sample.
+        bool Resample(int64_t targetNanoseconds, float *x, float *y) const;
+
+    private:
+        struct Sample
+        {
+            int64_t timestampNanoseconds;
+            float x, y;
+        };
+
+        Options m_options;
+        std::array<Sample, 2> m_samples{}; // Oldest first
+        size_t m_sampleCount = 0;
+    };
+}
+
+#endif // !A_TOUCH_RESAMPLER_H
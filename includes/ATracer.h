@@ -0,0 +1,52 @@
+#ifndef A_TRACER_H // !A_TRACER_H
+#define A_TRACER_H
+
+#include <cstdint>
+
+/**
+ * Scoped trace events, built only with ANDROID_SURFACE_IMGUI_ENABLE_TRACING. Without it
+ * AIMGUI_TRACE_SCOPE expands to nothing and the ATracer calls do nothing.
+ * Names must be string literals, only the pointer is recorded.
+ */
+#ifdef AIMGUI_ENABLE_TRACING
+#define AIMGUI_TRACE_CONCAT_IMPL(a, b) a##b
+#define AIMGUI_TRACE_CONCAT(a, b) AIMGUI_TRACE_CONCAT_IMPL(a, b)
+#define AIMGUI_TRACE_SCOPE(name) ::android::ATracer::Scope AIMGUI_TRACE_CONCAT(aimguiTraceScope, __LINE__)(name)
+#else
+#define AIMGUI_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace android
+{
+    class ATracer
+    {
+    public:
+        // Drop recorded events and start recording, atrace markers are emitted whenever atrace is enabled.
+        static void Start();
+        static void Stop();
+        static bool IsRecording();
+
+        // Write the recorded events as Chrome trace JSON, loadable in chrome://tracing and ui.perfetto.dev.
+        static bool WriteChromeJson(const char *path);
+
+#ifdef AIMGUI_ENABLE_TRACING
+        class Scope
+        {
+        public:
+            explicit Scope(const char *name);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            const char *m_name;
+            uint64_t m_beginNanoseconds;
+            bool m_recording;
+            bool m_atrace;
+        };
+#endif
+    };
+}
+
+#endif // !A_TRACER_H
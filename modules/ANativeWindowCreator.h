@@ -32,6 +32,8 @@
 #include <android/log.h>
 #include <android/native_window.h>
 
+#include <climits>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -40,6 +42,15 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 #ifndef LOGTAG
 #define LOGTAG "AImGui"
@@ -251,6 +262,9 @@ namespace android::anative_window_creator::detail::types::apis::libgui
         using SurfaceComposerClient__CloseGlobalTransaction__Static = void (*)(bool synchronous);
 
         using SurfaceControl__SetLayer = void *(*)(void *thiz, int32_t z);
+        using SurfaceControl__SetSize = void *(*)(void *thiz, uint32_t w, uint32_t h);
+        using SurfaceControl__Show = int32_t (*)(void *thiz);
+        using SurfaceControl__Hide = int32_t (*)(void *thiz);
 
         // enum {
         //     // The API number used to indicate the currently connected producer
@@ -281,6 +295,13 @@ namespace android::anative_window_creator::detail::types::apis::libgui
         using SurfaceComposerClient__Transaction__Apply = int32_t (*)(void *thiz, bool synchronous);
     } // namespace v8_v12
 
+    namespace v9_v12
+    {
+        // SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::setSize(
+        //         const sp<SurfaceControl>& sc, uint32_t w, uint32_t h)
+        using SurfaceComposerClient__Transaction__SetSize = void *(*)(void *thiz, StrongPointer<void> &surfaceControl, uint32_t w, uint32_t h);
+    } // namespace v9_v12
+
     namespace v10
     {
         // SurfaceComposerClient::createSurface(const String8& name, uint32_t w, uint32_t h,
@@ -472,6 +493,7 @@ namespace android::anative_window_creator::detail::apis
                 void *Reparent;
                 void *SetMatrix;
                 void *SetPosition;
+                void *SetSize;
                 void *SetInputWindowInfo;
                 void *Apply;
             };
@@ -488,6 +510,9 @@ namespace android::anative_window_creator::detail::apis
                 void *GetParentingLayer;
 
                 void *SetLayer;
+                void *SetSize;
+                void *Show;
+                void *Hide;
             };
 
             inline static ApiTable Api;
@@ -595,6 +620,12 @@ namespace android::anative_window_creator::detail::compat
             return reinterpret_cast<types::apis::libgui::generic::SurfaceControl__GetParentingLayer>(apis::libgui::SurfaceControl::Api.GetParentingLayer);
         if constexpr ("SurfaceControl::SetLayer" == descriptor)
             return reinterpret_cast<types::apis::libgui::v5_v7::SurfaceControl__SetLayer>(apis::libgui::SurfaceControl::Api.SetLayer);
+        if constexpr ("SurfaceControl::SetSize" == descriptor)
+            return reinterpret_cast<types::apis::libgui::v5_v7::SurfaceControl__SetSize>(apis::libgui::SurfaceControl::Api.SetSize);
+        if constexpr ("SurfaceControl::Show" == descriptor)
+            return reinterpret_cast<types::apis::libgui::v5_v7::SurfaceControl__Show>(apis::libgui::SurfaceControl::Api.Show);
+        if constexpr ("SurfaceControl::Hide" == descriptor)
+            return reinterpret_cast<types::apis::libgui::v5_v7::SurfaceControl__Hide>(apis::libgui::SurfaceControl::Api.Hide);
 
         if constexpr ("Surface::DisConnect" == descriptor)
             return reinterpret_cast<types::apis::libgui::v5_v7::Surface__DisConnect>(apis::libgui::Surface::Api.DisConnect);
@@ -622,6 +653,8 @@ namespace android::anative_window_creator::detail::compat
             return reinterpret_cast<types::apis::libgui::generic::SurfaceComposerClient__Transaction__SetMatrix>(apis::libgui::SurfaceComposerClient::Transaction::Api.SetMatrix);
         if constexpr ("SurfaceComposerClient::Transaction::SetPosition" == descriptor)
             return reinterpret_cast<types::apis::libgui::generic::SurfaceComposerClient__Transaction__SetPosition>(apis::libgui::SurfaceComposerClient::Transaction::Api.SetPosition);
+        if constexpr ("SurfaceComposerClient::Transaction::SetSize" == descriptor)
+            return reinterpret_cast<types::apis::libgui::v9_v12::SurfaceComposerClient__Transaction__SetSize>(apis::libgui::SurfaceComposerClient::Transaction::Api.SetSize);
         if constexpr ("SurfaceComposerClient::Transaction::SetInputWindowInfo" == descriptor)
         {
             if constexpr (10 <= descriptor.version && 12 >= descriptor.version)
@@ -812,6 +845,30 @@ namespace android::anative_window_creator::detail::compat
             ApiInvoker<"SurfaceControl::SetLayer@v8">()(data, z);
         }
 
+        void SetSize(uint32_t w, uint32_t h)
+        {
+            if (nullptr == data || 8 < SystemVersion)
+                return;
+
+            ApiInvoker<"SurfaceControl::SetSize@v8">()(data, w, h);
+        }
+
+        void Show()
+        {
+            if (nullptr == data || 8 < SystemVersion)
+                return;
+
+            ApiInvoker<"SurfaceControl::Show@v8">()(data);
+        }
+
+        void Hide()
+        {
+            if (nullptr == data || 8 < SystemVersion)
+                return;
+
+            ApiInvoker<"SurfaceControl::Hide@v8">()(data);
+        }
+
         void DestroySurface(Surface *surface)
         {
             if (nullptr == data || nullptr == surface)
@@ -878,6 +935,11 @@ namespace android::anative_window_creator::detail::compat
             ApiInvoker<"SurfaceComposerClient::Transaction::SetPosition">()(data, surfaceControl, x, y);
         }
 
+        void SetSize(types::StrongPointer<void> &surfaceControl, uint32_t w, uint32_t h)
+        {
+            ApiInvoker<"SurfaceComposerClient::Transaction::SetSize@v12">()(data, surfaceControl, w, h);
+        }
+
         void SetInputWindowInfo(types::StrongPointer<void> &surfaceControl, void *windowInfo)
         {
             ApiInvoker<"SurfaceComposerClient::Transaction::SetInputWindowInfo@v10">()(data, surfaceControl, windowInfo);
@@ -902,15 +964,22 @@ namespace android::anative_window_creator::detail::compat
             ApiInvoker<"RefBase::IncStrong">()(data, this);
         }
 
-        SurfaceControl CreateSurface(const char *name, int32_t width, int32_t height, types::WindowFlags windowFlags = {}, bool skipScreenshot = false)
+        SurfaceControl CreateSurface(const char *name, int32_t width, int32_t height, types::WindowFlags windowFlags = {}, bool skipScreenshot = false, types::PixelFormat pixelFormat = types::PixelFormat::RGBA_8888)
         {
             static void *parentHandle = nullptr;
 
             parentHandle = nullptr;
             String8 windowName(name);
-            types::PixelFormat pixelFormat = types::PixelFormat::RGBA_8888;
             LayerMetadata layerMetadata{};
 
+            // Formats without alpha let SurfaceFlinger skip blending the layer
+            if (types::PixelFormat::RGB_565 == pixelFormat || types::PixelFormat::RGBX_8888 == pixelFormat || types::PixelFormat::RGB_888 == pixelFormat)
+            {
+                using types::operator|=;
+
+                windowFlags |= types::WindowFlags::eOpaque;
+            }
+
             types::StrongPointer<void> result{};
             switch (SystemVersion)
             {
@@ -969,11 +1038,11 @@ namespace android::anative_window_creator::detail::compat
 
             if (12 <= SystemVersion)
             {
-                static SurfaceComposerClientTransaction transaction;
+                auto &transaction = AcquireTransaction();
 
                 transaction.SetTrustedOverlay(result, true);
                 transaction.SetLayer(result, INT_MAX);
-                transaction.Apply(false, true);
+                CommitTransaction(transaction);
             }
             else if (8 >= SystemVersion)
             {
@@ -1031,17 +1100,15 @@ namespace android::anative_window_creator::detail::compat
                 return {};
             }
 
-            static SurfaceComposerClientTransaction transaction;
             static std::vector<mirror_surfaces_proxy_t> mirrorSurfaces;
+            auto &transaction = AcquireTransaction();
 
             transaction.SetLayer(mirrorRootSurface, INT_MAX);
             transaction.SetLayerStack(mirrorRootSurface, layerStack);
-            transaction.Apply(false, true);
-
             transaction.SetLayerStack(mirrorSurface, layerStack);
             transaction.Show(mirrorSurface);
             transaction.Reparent(mirrorSurface, mirrorRootSurface);
-            transaction.Apply(false, true);
+            CommitTransaction(transaction);
 
             mirrorSurfaces.emplace_back(new mirror_surfaces_t{mirrorSurface.get(), mirrorRootSurface.data}, MirrorSurfacesDeleter);
 
@@ -1050,18 +1117,69 @@ namespace android::anative_window_creator::detail::compat
 
         void ZoomSurface(SurfaceControl &surface, float scaleX, float scaleY)
         {
-            static SurfaceComposerClientTransaction transaction;
+            auto &transaction = AcquireTransaction();
 
             transaction.SetMatrix(surface, scaleX, 0.f, 0.f, scaleY);
-            transaction.Apply(false, true);
+            CommitTransaction(transaction);
         }
 
         void MoveSurface(SurfaceControl &surface, float x, float y)
         {
-            static SurfaceComposerClientTransaction transaction;
+            auto &transaction = AcquireTransaction();
 
             transaction.SetPosition(surface, x, y);
-            transaction.Apply(false, true);
+            CommitTransaction(transaction);
+        }
+
+        void ResizeSurface(SurfaceControl &surface, int32_t width, int32_t height)
+        {
+            surface.width = width;
+            surface.height = height;
+
+            // Since Android 13 the layer size always follows the buffer size
+            if (12 < SystemVersion)
+                return;
+
+            if (9 <= SystemVersion)
+            {
+                auto &transaction = AcquireTransaction();
+
+                transaction.SetSize(surface, width, height);
+                CommitTransaction(transaction);
+            }
+            else if (0 < m_batchDepth)
+                RecordGlobalOperation({surface.data, GlobalOperation::Type::SetSize, width, height});
+            else
+            {
+                OpenGlobalTransaction();
+                surface.SetSize(width, height);
+                CloseGlobalTransaction(false);
+            }
+        }
+
+        void SetSurfaceVisible(SurfaceControl &surface, bool visible)
+        {
+            if (9 <= SystemVersion)
+            {
+                auto &transaction = AcquireTransaction();
+
+                if (visible)
+                    transaction.Show(surface);
+                else
+                    transaction.Hide(surface);
+                CommitTransaction(transaction);
+            }
+            else if (0 < m_batchDepth)
+                RecordGlobalOperation({surface.data, visible ? GlobalOperation::Type::Show : GlobalOperation::Type::Hide, 0, 0});
+            else
+            {
+                OpenGlobalTransaction();
+                if (visible)
+                    surface.Show();
+                else
+                    surface.Hide();
+                CloseGlobalTransaction(false);
+            }
         }
 
         bool GetDisplayInfo(types::ui::DisplayState *displayInfo)
@@ -1103,14 +1221,42 @@ namespace android::anative_window_creator::detail::compat
             }
         }
 
+        // Enumerate the physical displays and their layer stacks through libgui, available since Android 14.
+        template <typename callback_t>
+        bool ForEachPhysicalDisplay(callback_t &&callback)
+        {
+            if (14 > SystemVersion)
+                return false;
+
+            auto displayIds = ApiInvoker<"SurfaceComposerClient::GetPhysicalDisplayIds@v14">()();
+            for (const auto &displayId : displayIds)
+            {
+                auto displayToken = ApiInvoker<"SurfaceComposerClient::GetPhysicalDisplayToken@v14">()(displayId);
+                if (nullptr == displayToken.get())
+                    continue;
+
+                types::ui::DisplayState displayState{};
+                if (0 != ApiInvoker<"SurfaceComposerClient::GetDisplayState@v14">()(displayToken, &displayState))
+                    continue;
+
+                callback(displayId.value, displayState);
+            }
+
+            return true;
+        }
+
+        // The global transaction is shared by the whole process, a thread keeps it to itself from
+        // its outermost open to the matching close so that no other thread closes its half built changes.
         void OpenGlobalTransaction()
         {
+            GetGlobalTransactionMutex().lock();
             ApiInvoker<"SurfaceComposerClient::OpenGlobalTransaction@v7">()();
         }
 
         void CloseGlobalTransaction(bool synchronous)
         {
             ApiInvoker<"SurfaceComposerClient::CloseGlobalTransaction@v7">()(synchronous);
+            GetGlobalTransactionMutex().unlock();
         }
 
         SurfaceComposerClientTransaction &GetDefaultTransaction()
@@ -1119,6 +1265,130 @@ namespace android::anative_window_creator::detail::compat
 
             return transaction;
         }
+
+        // Surface operations issued on this thread until ApplyTransactionBatch are merged into
+        // a single transaction. Android 8 and lower have only the process wide global transaction,
+        // the operations are recorded and replayed into it at once so that it is held only that long.
+        void BeginTransactionBatch()
+        {
+            ++m_batchDepth;
+        }
+
+        // Send what the open batch recorded so far without closing it.
+        void FlushTransactionBatch()
+        {
+            if (0 == m_batchDepth)
+                return;
+
+            if (8 >= SystemVersion)
+                ApplyGlobalOperations();
+            else if (m_batchPending)
+                GetBatchTransaction().Apply(false, true);
+
+            m_batchPending = false;
+        }
+
+        void ApplyTransactionBatch()
+        {
+            if (0 == m_batchDepth || 0 != --m_batchDepth)
+                return;
+
+            if (8 >= SystemVersion)
+                ApplyGlobalOperations();
+            else if (m_batchPending)
+                GetBatchTransaction().Apply(false, true);
+
+            m_batchPending = false;
+        }
+
+        // Forget the recorded operations of a surface about to be destroyed.
+        void DiscardGlobalOperations(const SurfaceControl &surface)
+        {
+            auto end = std::remove_if(m_globalOperations.begin(), m_globalOperations.begin() + m_globalOperationCount, [&surface](const auto &operation)
+                                      { return operation.surface == surface.data; });
+            m_globalOperationCount = end - m_globalOperations.begin();
+        }
+
+    private:
+        struct GlobalOperation
+        {
+            enum class Type
+            {
+                SetSize,
+                Show,
+                Hide,
+            };
+
+            void *surface;
+            Type type;
+            int32_t width, height;
+        };
+
+        void RecordGlobalOperation(const GlobalOperation &operation)
+        {
+            if (m_globalOperations.size() == m_globalOperationCount)
+                ApplyGlobalOperations();
+
+            m_globalOperations[m_globalOperationCount++] = operation;
+        }
+
+        void ApplyGlobalOperations()
+        {
+            if (0 == m_globalOperationCount)
+                return;
+
+            OpenGlobalTransaction();
+            for (size_t i = 0; i < m_globalOperationCount; ++i)
+            {
+                const auto &operation = m_globalOperations[i];
+                SurfaceControl surface{operation.surface};
+
+                if (GlobalOperation::Type::SetSize == operation.type)
+                    surface.SetSize(operation.width, operation.height);
+                else if (GlobalOperation::Type::Show == operation.type)
+                    surface.Show();
+                else
+                    surface.Hide();
+            }
+            CloseGlobalTransaction(false);
+
+            m_globalOperationCount = 0;
+        }
+
+        static std::recursive_mutex &GetGlobalTransactionMutex()
+        {
+            static std::recursive_mutex mutex;
+
+            return mutex;
+        }
+
+        static SurfaceComposerClientTransaction &GetBatchTransaction()
+        {
+            static thread_local SurfaceComposerClientTransaction transaction;
+
+            return transaction;
+        }
+
+        SurfaceComposerClientTransaction &AcquireTransaction()
+        {
+            if (0 < m_batchDepth && 9 <= SystemVersion)
+                return GetBatchTransaction();
+
+            return GetDefaultTransaction();
+        }
+
+        void CommitTransaction(SurfaceComposerClientTransaction &transaction)
+        {
+            if (0 < m_batchDepth && 9 <= SystemVersion)
+                m_batchPending = true;
+            else
+                transaction.Apply(false, true);
+        }
+
+        inline static thread_local size_t m_batchDepth = 0;
+        inline static thread_local bool m_batchPending = false;
+        inline static thread_local std::array<GlobalOperation, 16> m_globalOperations{};
+        inline static thread_local size_t m_globalOperationCount = 0;
     };
 } // namespace android::anative_window_creator::detail::compat
 
@@ -1172,7 +1442,7 @@ namespace android::anative_window_creator::detail
                     ApiDescriptor{11, UINT_MAX, &apis::libgui::SurfaceComposerClient::Api.GetDisplayState, "_ZN7android21SurfaceComposerClient15getDisplayStateERKNS_2spINS_7IBinderEEEPNS_2ui12DisplayStateE"},
 
                     // SurfaceComposerClient::Transaction
-                    ApiDescriptor{11, 11, &apis::libgui::SurfaceComposerClient::Transaction::Api.CopyConstructor, "_ZN7android21SurfaceComposerClient11TransactionC2ERKS1_"},
+                    ApiDescriptor{9, 11, &apis::libgui::SurfaceComposerClient::Transaction::Api.CopyConstructor, "_ZN7android21SurfaceComposerClient11TransactionC2ERKS1_"},
                     ApiDescriptor{12, UINT_MAX, &apis::libgui::SurfaceComposerClient::Transaction::Api.Constructor, "_ZN7android21SurfaceComposerClient11TransactionC2Ev"},
                     ApiDescriptor{9, UINT_MAX, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetLayer, "_ZN7android21SurfaceComposerClient11Transaction8setLayerERKNS_2spINS_14SurfaceControlEEEi"},
                     ApiDescriptor{12, UINT_MAX, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetTrustedOverlay, "_ZN7android21SurfaceComposerClient11Transaction17setTrustedOverlayERKNS_2spINS_14SurfaceControlEEEb"},
@@ -1187,6 +1457,7 @@ namespace android::anative_window_creator::detail
 
                     ApiDescriptor{9, UINT_MAX, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetMatrix, "_ZN7android21SurfaceComposerClient11Transaction9setMatrixERKNS_2spINS_14SurfaceControlEEEffff"},
                     ApiDescriptor{9, UINT_MAX, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetPosition, "_ZN7android21SurfaceComposerClient11Transaction11setPositionERKNS_2spINS_14SurfaceControlEEEff"},
+                    ApiDescriptor{9, 12, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetSize, "_ZN7android21SurfaceComposerClient11Transaction7setSizeERKNS_2spINS_14SurfaceControlEEEjj"},
 
                     ApiDescriptor{10, 12, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetInputWindowInfo, "_ZN7android21SurfaceComposerClient11Transaction18setInputWindowInfoERKNS_2spINS_14SurfaceControlEEERKNS_15InputWindowInfoE"},
                     ApiDescriptor{13, 15, &apis::libgui::SurfaceComposerClient::Transaction::Api.SetInputWindowInfo, "_ZN7android21SurfaceComposerClient11Transaction18setInputWindowInfoERKNS_2spINS_14SurfaceControlEEERKNS_3gui10WindowInfoE"},
@@ -1208,6 +1479,10 @@ namespace android::anative_window_creator::detail
                     ApiDescriptor{5, 5, &apis::libgui::SurfaceControl::Api.SetLayer, "_ZN7android14SurfaceControl8setLayerEi"},
                     ApiDescriptor{6, 7, &apis::libgui::SurfaceControl::Api.SetLayer, "_ZN7android14SurfaceControl8setLayerEj"},
                     ApiDescriptor{8, 8, &apis::libgui::SurfaceControl::Api.SetLayer, "_ZN7android14SurfaceControl8setLayerEi"},
+
+                    ApiDescriptor{5, 8, &apis::libgui::SurfaceControl::Api.SetSize, "_ZN7android14SurfaceControl7setSizeEjj"},
+                    ApiDescriptor{5, 8, &apis::libgui::SurfaceControl::Api.Show, "_ZN7android14SurfaceControl4showEv"},
+                    ApiDescriptor{5, 8, &apis::libgui::SurfaceControl::Api.Hide, "_ZN7android14SurfaceControl4hideEv"},
                 }));
         }
     };
@@ -1304,7 +1579,7 @@ namespace android::anative_window_creator::detail
 
     struct DumpDisplayInfo
     {
-        std::string uniqueId;
+        char uniqueId[128];
         uint32_t currentLayerStack;
         struct
         {
@@ -1314,26 +1589,13 @@ namespace android::anative_window_creator::detail
             int32_t bottom;
         } currentLayerStackRect;
 
-        static DumpDisplayInfo MakeFromRawDumpInfo(const std::string_view &uniqueId, const std::string_view &currentLayerStack, const std::string_view &currentLayerStackRect)
+        bool IsSameLayerStack(const DumpDisplayInfo &other) const
         {
-            DumpDisplayInfo result;
-
-            result.uniqueId = std::string{uniqueId.begin(), uniqueId.end()};
-            result.currentLayerStack = static_cast<uint32_t>(std::stoul(std::string{currentLayerStack.begin(), currentLayerStack.end()}));
-
-            auto leftPos = currentLayerStackRect.find("(") + 1;
-            auto topPos = currentLayerStackRect.find(", ", leftPos);
-            auto rightPos = currentLayerStackRect.find(" - ", topPos + 2);
-            auto bottomPos = currentLayerStackRect.find(", ", rightPos + 3);
-            auto endPos = currentLayerStackRect.find(")", bottomPos + 2);
-
-            // Don't check it, even though it might cause a crash.
-            result.currentLayerStackRect.left = std::stoi(std::string{currentLayerStackRect.begin() + leftPos, currentLayerStackRect.begin() + topPos});
-            result.currentLayerStackRect.top = std::stoi(std::string{currentLayerStackRect.begin() + topPos + 2, currentLayerStackRect.begin() + rightPos});
-            result.currentLayerStackRect.right = std::stoi(std::string{currentLayerStackRect.begin() + rightPos + 3, currentLayerStackRect.begin() + bottomPos});
-            result.currentLayerStackRect.bottom = std::stoi(std::string{currentLayerStackRect.begin() + bottomPos + 2, currentLayerStackRect.begin() + endPos});
-
-            return result;
+            return currentLayerStack == other.currentLayerStack &&
+                   currentLayerStackRect.left == other.currentLayerStackRect.left &&
+                   currentLayerStackRect.top == other.currentLayerStackRect.top &&
+                   currentLayerStackRect.right == other.currentLayerStackRect.right &&
+                   currentLayerStackRect.bottom == other.currentLayerStackRect.bottom;
         }
     };
 
@@ -1346,43 +1608,176 @@ namespace android::anative_window_creator::detail
         float offsetY;
     };
 
-    inline std::vector<DumpDisplayInfo> ParseDumpDisplayInfo(const std::string_view &dumpDisplayInfo)
+    // Incremental "dumpsys display" parser, fed line by line and never allocates.
+    struct DumpDisplayInfoParser
     {
-        constexpr auto SubStringView = [](const std::string_view &str, std::string_view start, std::string_view end, int startOffset = 0) -> std::string_view
+        static constexpr size_t MaxDisplays = 16;
+
+        std::array<DumpDisplayInfo, MaxDisplays> displays{};
+        size_t displayCount = 0;
+
+        void Reset()
         {
-            auto startIt = str.find(start, startOffset);
-            if (std::string::npos == startIt)
-                return {};
+            displayCount = 0;
+            m_hasCurrent = false;
+        }
 
-            auto endIt = str.find(end, startIt + start.size());
-            if (std::string::npos == endIt)
-                return {};
+        void Add(const DumpDisplayInfo &displayInfo)
+        {
+            for (size_t i = 0; i < displayCount; ++i)
+            {
+                if (displays[i].currentLayerStack == displayInfo.currentLayerStack)
+                    return;
+            }
+            if (MaxDisplays > displayCount)
+                displays[displayCount++] = displayInfo;
+        }
 
-            return str.substr(startIt + start.size(), endIt - startIt - start.size());
-        };
+        void ParseLine(std::string_view line)
+        {
+            while (!line.empty() && (' ' == line.front() || '\t' == line.front()))
+                line.remove_prefix(1);
+            while (!line.empty() && ('\n' == line.back() || '\r' == line.back()))
+                line.remove_suffix(1);
+
+            if (std::string_view::npos != line.find("DisplayDeviceInfo{"))
+            {
+                Finish();
+
+                m_current = {};
+                m_hasCurrent = true;
+                m_hasLayerStack = false;
+                m_hasLayerStackRect = false;
+                return;
+            }
+            if (!m_hasCurrent)
+                return;
+
+            if (line.starts_with("mUniqueId="))
+            {
+                line.remove_prefix(sizeof("mUniqueId=") - 1);
+
+                auto length = std::min(line.size(), sizeof(m_current.uniqueId) - 1);
+                std::copy_n(line.data(), length, m_current.uniqueId);
+                m_current.uniqueId[length] = 0;
+            }
+            else if (line.starts_with("mCurrentLayerStack="))
+            {
+                int64_t layerStack = -1;
+
+                line.remove_prefix(sizeof("mCurrentLayerStack=") - 1);
+                std::from_chars(line.data(), line.data() + line.size(), layerStack);
+                m_current.currentLayerStack = static_cast<uint32_t>(layerStack);
+                m_hasLayerStack = -1 != layerStack;
+                if (!m_hasLayerStack)
+                    LogError("[-] %s -> Current layer stack is -1, skipping", m_current.uniqueId);
+            }
+            else if (line.starts_with("mCurrentLayerStackRect="))
+            {
+                // Rect(left, top - right, bottom)
+                int32_t *values[] = {
+                    &m_current.currentLayerStackRect.left,
+                    &m_current.currentLayerStackRect.top,
+                    &m_current.currentLayerStackRect.right,
+                    &m_current.currentLayerStackRect.bottom,
+                };
+                auto it = line.data() + sizeof("mCurrentLayerStackRect=") - 1;
+                auto end = line.data() + line.size();
+
+                m_hasLayerStackRect = true;
+                for (auto value : values)
+                {
+                    while (end != it && !std::isdigit(static_cast<unsigned char>(*it)) && !('-' == *it && end != it + 1 && std::isdigit(static_cast<unsigned char>(it[1]))))
+                        ++it;
+
+                    auto [next, errorCode] = std::from_chars(it, end, *value);
+                    if (std::errc{} != errorCode)
+                    {
+                        m_hasLayerStackRect = false;
+                        break;
+                    }
+                    it = next;
+                }
+            }
+        }
+
+        void Finish()
+        {
+            if (m_hasCurrent && m_hasLayerStack && m_hasLayerStackRect)
+                Add(m_current);
+
+            m_hasCurrent = false;
+        }
+
+    private:
+        DumpDisplayInfo m_current{};
+        bool m_hasCurrent = false;
+        bool m_hasLayerStack = false;
+        bool m_hasLayerStackRect = false;
+    };
+
+    // Runs a task on a background thread at a fixed interval until stopped.
+    class PeriodicWorker
+    {
+    public:
+        ~PeriodicWorker()
+        {
+            Stop();
+        }
+
+        template <typename task_t>
+        void Start(std::chrono::milliseconds interval, task_t &&task)
+        {
+            std::lock_guard lock(m_mutex);
+
+            if (m_running)
+                return;
 
-        std::vector<DumpDisplayInfo> result;
+            m_running = true;
+            m_thread = std::make_unique<std::thread>(
+                [this, interval, task = std::forward<task_t>(task)]() mutable
+                {
+                    std::unique_lock lock(m_mutex);
+
+                    while (m_running)
+                    {
+                        lock.unlock();
+                        task();
+                        lock.lock();
+
+                        m_condition.wait_for(lock, interval, [this]
+                                             { return !m_running; });
+                    }
+                });
+        }
 
-        // DisplayDeviceInfo
-        auto dumpDisplayInfoIt = std::string_view::npos;
-        while (std::string_view::npos != (dumpDisplayInfoIt = dumpDisplayInfo.find("DisplayDeviceInfo", dumpDisplayInfoIt + 1)))
+        void Stop()
         {
-            auto uniqueId = SubStringView(dumpDisplayInfo, "mUniqueId=", "\n", dumpDisplayInfoIt);
-            auto currentLayerStack = SubStringView(dumpDisplayInfo, "mCurrentLayerStack=", "\n", dumpDisplayInfoIt);
-            auto currentLayerStackRect = SubStringView(dumpDisplayInfo, "mCurrentLayerStackRect=", "\n", dumpDisplayInfoIt);
+            std::unique_ptr<std::thread> thread;
 
-            if ("-1" == currentLayerStack)
             {
-                LogError("[-] %s -> Current layer stack is -1, skipping", std::string{uniqueId.begin(), uniqueId.end()}.data());
+                std::lock_guard lock(m_mutex);
 
-                continue;
+                m_running = false;
+                thread.swap(m_thread);
             }
+            m_condition.notify_all();
 
-            result.push_back(DumpDisplayInfo::MakeFromRawDumpInfo(uniqueId, currentLayerStack, currentLayerStackRect));
+            if (thread && thread->joinable())
+                thread->join();
         }
 
-        return result;
-    }
+        bool IsRunning() const
+        {
+            return m_running;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::unique_ptr<std::thread> m_thread;
+        std::atomic<bool> m_running = false;
+    };
 
     inline MirrorLayerTransform CalcMirrorLayerTransform(float targetWidth, float targetHeight, float sourceWidth, float sourceHeight, float epsilon = 0.002)
     {
@@ -1430,6 +1825,7 @@ namespace android
             int32_t width;
             int32_t height;
             bool skipScreenshot;
+            anative_window_creator::detail::types::PixelFormat pixelFormat; // UNKNOWN selects RGBA_8888
         };
 
     public:
@@ -1463,6 +1859,56 @@ namespace android
             };
         }
 
+        // Read the display state refreshed by the display watcher, falls back to a synchronous
+        // query while the watcher is not running or has not produced a result yet.
+        static DisplayInfo GetCachedDisplayInfo()
+        {
+            auto packedDisplayInfo = m_cachedDisplayInfo.load(std::memory_order_acquire);
+            if (0 == packedDisplayInfo)
+                return GetDisplayInfo();
+
+            return DisplayInfo{
+                .theta = static_cast<int32_t>(packedDisplayInfo >> 48),
+                .width = static_cast<int32_t>((packedDisplayInfo >> 24) & 0xFFFFFF),
+                .height = static_cast<int32_t>(packedDisplayInfo & 0xFFFFFF),
+            };
+        }
+
+        static void StartDisplayWatcher(std::chrono::milliseconds interval = std::chrono::milliseconds(250))
+        {
+            std::lock_guard lock(m_displayWatcherMutex);
+
+            if (0 != m_displayWatcherReferences++)
+                return;
+
+            GetComposerInstance();
+            m_displayWatcher.Start(
+                interval,
+                []
+                {
+                    auto displayInfo = GetDisplayInfo();
+                    if (0 >= displayInfo.width || 0 >= displayInfo.height)
+                        return;
+
+                    m_cachedDisplayInfo.store(
+                        static_cast<uint64_t>(displayInfo.theta) << 48 | static_cast<uint64_t>(displayInfo.width & 0xFFFFFF) << 24 | static_cast<uint64_t>(displayInfo.height & 0xFFFFFF),
+                        std::memory_order_release);
+                });
+        }
+
+        static void StopDisplayWatcher()
+        {
+            {
+                std::lock_guard lock(m_displayWatcherMutex);
+
+                if (0 == m_displayWatcherReferences || 0 != --m_displayWatcherReferences)
+                    return;
+            }
+
+            m_displayWatcher.Stop();
+            m_cachedDisplayInfo.store(0, std::memory_order_release);
+        }
+
         static ANativeWindow *Create(const CreateOptions &options = {.name = "AImGui"})
         {
             auto &surfaceComposerClient = GetComposerInstance();
@@ -1482,30 +1928,115 @@ namespace android
                 break;
             }
 
-            auto surfaceControl = surfaceComposerClient.CreateSurface(options.name, width, height, {}, options.skipScreenshot);
+            auto surfaceControl = surfaceComposerClient.CreateSurface(
+                options.name,
+                width,
+                height,
+                {},
+                options.skipScreenshot,
+                anative_window_creator::detail::types::PixelFormat::UNKNOWN == options.pixelFormat ? anative_window_creator::detail::types::PixelFormat::RGBA_8888 : options.pixelFormat);
             auto nativeWindow = reinterpret_cast<ANativeWindow *>(surfaceControl.GetSurface());
 
             m_cachedSurfaceControl.emplace(nativeWindow, std::move(surfaceControl));
             return nativeWindow;
         }
 
+        static void Resize(ANativeWindow *nativeWindow, int32_t width, int32_t height)
+        {
+            if (!m_cachedSurfaceControl.contains(nativeWindow))
+                return;
+
+            GetComposerInstance().ResizeSurface(m_cachedSurfaceControl.at(nativeWindow), width, height);
+            ANativeWindow_setBuffersGeometry(nativeWindow, width, height, ANativeWindow_getFormat(nativeWindow));
+        }
+
+        // Defer the surface operations of the calling thread and apply them at once with ApplyTransactionBatch.
+        static void BeginTransactionBatch()
+        {
+            GetComposerInstance().BeginTransactionBatch();
+        }
+
+        static void FlushTransactionBatch()
+        {
+            GetComposerInstance().FlushTransactionBatch();
+        }
+
+        static void ApplyTransactionBatch()
+        {
+            GetComposerInstance().ApplyTransactionBatch();
+        }
+
+        static void Show(ANativeWindow *nativeWindow)
+        {
+            if (!m_cachedSurfaceControl.contains(nativeWindow))
+                return;
+
+            GetComposerInstance().SetSurfaceVisible(m_cachedSurfaceControl.at(nativeWindow), true);
+        }
+
+        static void Hide(ANativeWindow *nativeWindow)
+        {
+            if (!m_cachedSurfaceControl.contains(nativeWindow))
+                return;
+
+            GetComposerInstance().SetSurfaceVisible(m_cachedSurfaceControl.at(nativeWindow), false);
+        }
+
+        static void SetScale(ANativeWindow *nativeWindow, float scaleX, float scaleY)
+        {
+            if (!m_cachedSurfaceControl.contains(nativeWindow))
+                return;
+
+            GetComposerInstance().ZoomSurface(m_cachedSurfaceControl.at(nativeWindow), scaleX, scaleY);
+        }
+
+        static void SetPosition(ANativeWindow *nativeWindow, float x, float y)
+        {
+            if (!m_cachedSurfaceControl.contains(nativeWindow))
+                return;
+
+            GetComposerInstance().MoveSurface(m_cachedSurfaceControl.at(nativeWindow), x, y);
+        }
+
         static void Destroy(ANativeWindow *nativeWindow)
         {
             if (!m_cachedSurfaceControl.contains(nativeWindow))
                 return;
 
+            GetComposerInstance().DiscardGlobalOperations(m_cachedSurfaceControl[nativeWindow]);
             m_cachedSurfaceControl[nativeWindow].DestroySurface(reinterpret_cast<anative_window_creator::detail::compat::Surface *>(nativeWindow));
             m_cachedSurfaceControl.erase(nativeWindow);
+
+            if (!HasSurfacesNeedToMirror())
+                StopDisplayTracker();
         }
 
         static void ProcessMirrorDisplay()
         {
-            static std::chrono::steady_clock::time_point lastTime{};
+            static uint32_t lastGeneration = 0;
+            static std::array<anative_window_creator::detail::DumpDisplayInfo, anative_window_creator::detail::DumpDisplayInfoParser::MaxDisplays> dumpDisplayInfos;
+            static size_t dumpDisplayInfoCount = 0;
 
             if (14 > anative_window_creator::detail::compat::SystemVersion)
                 return;
-            if (std::chrono::steady_clock::now() - lastTime < std::chrono::seconds(1))
+
+            if (!m_displayTracker.IsRunning())
+            {
+                if (HasSurfacesNeedToMirror())
+                    StartDisplayTracker();
                 return;
+            }
+
+            // Only pick up the display list when the tracker published a new one
+            if (lastGeneration == m_trackedDisplaysGeneration.load(std::memory_order_acquire))
+                return;
+            {
+                std::lock_guard lock(m_trackedDisplaysMutex);
+
+                dumpDisplayInfoCount = m_trackedDisplaysCount;
+                std::copy_n(m_trackedDisplays.begin(), dumpDisplayInfoCount, dumpDisplayInfos.begin());
+                lastGeneration = m_trackedDisplaysGeneration.load(std::memory_order_relaxed);
+            }
 
             // Check if have surfaces need to mirror
             static std::vector<anative_window_creator::detail::compat::SurfaceControl *> surfacesNeedToMirror;
@@ -1519,33 +2050,23 @@ namespace android
             if (surfacesNeedToMirror.empty())
                 return;
 
-            // Run "dumpsys display" and get result
-            auto pipe = popen("dumpsys display", "r");
-            if (!pipe)
-            {
-                LogError("[-] Failed to run dumpsys command");
-                return;
-            }
-
-            char buffer[512]{};
-            std::string dumpDisplayResult;
-            while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
-                dumpDisplayResult += buffer;
-            pclose(pipe);
-
             static std::unordered_map<uint32_t, std::vector<anative_window_creator::detail::compat::SurfaceControl>> cachedLayerStackMirrorSurfaces;
             static std::unordered_set<uint32_t> cachedLayerStackScales;
 
-            auto dumpDisplayInfos = anative_window_creator::detail::ParseDumpDisplayInfo(dumpDisplayResult);
-            for (auto &displayInfo : dumpDisplayInfos)
+            // Update multi display layer scale
+            int32_t builtinDisplayWidth = -1, builtinDisplayHeight = -1;
+            for (size_t i = 0; i < dumpDisplayInfoCount; ++i)
             {
-                // Update multi display layer scale
-                static int32_t builtinDisplayWidth = -1, builtinDisplayHeight = -1;
-                if (0 == displayInfo.currentLayerStack)
+                if (0 == dumpDisplayInfos[i].currentLayerStack)
                 {
-                    builtinDisplayWidth = displayInfo.currentLayerStackRect.right;
-                    builtinDisplayHeight = displayInfo.currentLayerStackRect.bottom;
+                    builtinDisplayWidth = dumpDisplayInfos[i].currentLayerStackRect.right;
+                    builtinDisplayHeight = dumpDisplayInfos[i].currentLayerStackRect.bottom;
                 }
+            }
+
+            for (size_t i = 0; i < dumpDisplayInfoCount; ++i)
+            {
+                auto &displayInfo = dumpDisplayInfos[i];
 
                 // Process mirror display
                 if (0 == displayInfo.currentLayerStack)
@@ -1553,7 +2074,7 @@ namespace android
 
                 if (!cachedLayerStackMirrorSurfaces.contains(displayInfo.currentLayerStack))
                 {
-                    LogInfo("[=] New display layerstack detected: [%s] -> %u", displayInfo.uniqueId.data(), displayInfo.currentLayerStack);
+                    LogInfo("[=] New display layerstack detected: [%s] -> %u", displayInfo.uniqueId, displayInfo.currentLayerStack);
 
                     for (auto surfaceControl : surfacesNeedToMirror)
                     {
@@ -1602,8 +2123,13 @@ namespace android
                     }
                 }
             }
+        }
 
-            lastTime = std::chrono::steady_clock::now();
+        // Virtual displays (casting, screen recording) are only found through "dumpsys display", which
+        // runs every VirtualDisplayPollSeconds while this is enabled. Enabled by default.
+        static void SetVirtualDisplayTracking(bool enabled)
+        {
+            m_trackVirtualDisplays.store(enabled, std::memory_order_relaxed);
         }
 
         static void UpdateWindowInfo(ANativeWindow *nativeWindow, void *windowInfo)
@@ -1619,8 +2145,102 @@ namespace android
             transaction.Apply(true, false);
         }
 
+    private:
+        static bool HasSurfacesNeedToMirror()
+        {
+            return std::any_of(m_cachedSurfaceControl.begin(), m_cachedSurfaceControl.end(), [](const auto &item)
+                               { return !item.second.skipScreenshot; });
+        }
+
+        // Collect the display layer stacks off the render thread: physical displays through libgui,
+        // virtual displays (not reported by GetPhysicalDisplayIds) through "dumpsys display". Dumpsys
+        // forks a process, it runs every second only while the native query fails, otherwise every
+        // VirtualDisplayPollSeconds with the displays it found reused in between.
+        static void StartDisplayTracker()
+        {
+            m_displayTracker.Start(
+                std::chrono::seconds(1),
+                []
+                {
+                    static anative_window_creator::detail::DumpDisplayInfoParser parser;
+                    static anative_window_creator::detail::DumpDisplayInfoParser dumpParser;
+                    static char lineBuffer[1024];
+                    static size_t tick = 0;
+
+                    size_t physicalDisplayCount = 0;
+                    parser.Reset();
+                    auto queried = GetComposerInstance().ForEachPhysicalDisplay(
+                        [&physicalDisplayCount](uint64_t displayId, const anative_window_creator::detail::types::ui::DisplayState &displayState)
+                        {
+                            ++physicalDisplayCount;
+                            anative_window_creator::detail::DumpDisplayInfo displayInfo{};
+
+                            snprintf(displayInfo.uniqueId, sizeof(displayInfo.uniqueId), "physical:%llu", static_cast<unsigned long long>(displayId));
+                            displayInfo.currentLayerStack = displayState.layerStack.id;
+                            displayInfo.currentLayerStackRect.right = displayState.layerStackSpaceRect.width;
+                            displayInfo.currentLayerStackRect.bottom = displayState.layerStackSpaceRect.height;
+                            parser.Add(displayInfo);
+                        });
+
+                    auto trackVirtualDisplays = m_trackVirtualDisplays.load(std::memory_order_relaxed);
+                    auto pollVirtualDisplays = trackVirtualDisplays && 0 == tick++ % VirtualDisplayPollSeconds;
+                    if (!queried || 0 == physicalDisplayCount || pollVirtualDisplays)
+                    {
+                        dumpParser.Reset();
+                        auto pipe = popen("dumpsys display", "r");
+                        if (!pipe)
+                            LogError("[-] Failed to run dumpsys command");
+                        else
+                        {
+                            while (nullptr != fgets(lineBuffer, sizeof(lineBuffer), pipe))
+                                dumpParser.ParseLine(lineBuffer);
+                            pclose(pipe);
+                        }
+                        dumpParser.Finish();
+                    }
+                    else if (!trackVirtualDisplays)
+                        dumpParser.Reset();
+
+                    // Physical displays were added first, the same layer stacks from dumpsys are skipped
+                    for (size_t i = 0; i < dumpParser.displayCount; ++i)
+                        parser.Add(dumpParser.displays[i]);
+
+                    std::lock_guard lock(m_trackedDisplaysMutex);
+                    if (parser.displayCount == m_trackedDisplaysCount && std::equal(parser.displays.begin(), parser.displays.begin() + parser.displayCount, m_trackedDisplays.begin(), [](const auto &lhs, const auto &rhs)
+                                                                                    { return lhs.IsSameLayerStack(rhs); }))
+                        return;
+
+                    std::copy_n(parser.displays.begin(), parser.displayCount, m_trackedDisplays.begin());
+                    m_trackedDisplaysCount = parser.displayCount;
+                    m_trackedDisplaysGeneration.fetch_add(1, std::memory_order_release);
+                });
+        }
+
+        static void StopDisplayTracker()
+        {
+            m_displayTracker.Stop();
+
+            std::lock_guard lock(m_trackedDisplaysMutex);
+            m_trackedDisplaysCount = 0;
+        }
+
     private:
         inline static std::unordered_map<ANativeWindow *, anative_window_creator::detail::compat::SurfaceControl> m_cachedSurfaceControl;
+
+        // Packed as theta << 48 | width << 24 | height so the frame loop reads it with one atomic load
+        inline static std::atomic<uint64_t> m_cachedDisplayInfo = 0;
+        inline static std::mutex m_displayWatcherMutex;
+        inline static size_t m_displayWatcherReferences = 0;
+        inline static anative_window_creator::detail::PeriodicWorker m_displayWatcher;
+
+        // Display layer stacks published by the display tracker for ProcessMirrorDisplay
+        inline static std::mutex m_trackedDisplaysMutex;
+        inline static std::atomic<uint32_t> m_trackedDisplaysGeneration = 0;
+        inline static std::array<anative_window_creator::detail::DumpDisplayInfo, anative_window_creator::detail::DumpDisplayInfoParser::MaxDisplays> m_trackedDisplays{};
+        inline static size_t m_trackedDisplaysCount = 0;
+        static constexpr size_t VirtualDisplayPollSeconds = 3;
+        inline static std::atomic<bool> m_trackVirtualDisplays = true;
+        inline static anative_window_creator::detail::PeriodicWorker m_displayTracker;
     };
 } // namespace android
 
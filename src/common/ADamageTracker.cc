@@ -0,0 +1,162 @@
+#include "ADamageTracker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+    constexpr uint64_t prime = 0x100000001B3ull;
+    auto bytes = reinterpret_cast<const uint8_t *>(data);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * prime;
+
+    return hash;
+}
+
+namespace android
+{
+    ADamageTracker::Rect ADamageTracker::Rect::Union(const Rect &other) const
+    {
+        if (IsEmpty())
+            return other;
+        if (other.IsEmpty())
+            return *this;
+
+        return {
+            std::min(left, other.left),
+            std::min(top, other.top),
+            std::max(right, other.right),
+            std::max(bottom, other.bottom),
+        };
+    }
+
+    ADamageTracker::Rect ADamageTracker::Rect::Intersect(const Rect &other) const
+    {
+        Rect result{
+            std::max(left, other.left),
+            std::max(top, other.top),
+            std::min(right, other.right),
+            std::min(bottom, other.bottom),
+        };
+
+        return result.IsEmpty() ? Rect{} : result;
+    }
+
+    ADamageTracker::Rect ADamageTracker::Update(const ImDrawData *drawData, int bufferAge)
+    {
+        Rect framebufferRect{
+            0,
+            0,
+            static_cast<int32_t>(drawData->DisplaySize.x * drawData->FramebufferScale.x),
+            static_cast<int32_t>(drawData->DisplaySize.y * drawData->FramebufferScale.y),
+        };
+        if (framebufferRect.right != m_framebufferRect.right || framebufferRect.bottom != m_framebufferRect.bottom)
+        {
+            Invalidate();
+            m_framebufferRect = framebufferRect;
+        }
+
+        Rect damage{};
+        m_currentLists.clear();
+        for (int i = 0; i < drawData->CmdListsCount; ++i)
+        {
+            const auto cmdList = drawData->CmdLists[i];
+            float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+            for (const auto &vertex : cmdList->VtxBuffer)
+            {
+                minX = std::min(minX, vertex.pos.x);
+                minY = std::min(minY, vertex.pos.y);
+                maxX = std::max(maxX, vertex.pos.x);
+                maxY = std::max(maxY, vertex.pos.y);
+            }
+
+            uint64_t hash = 0xCBF29CE484222325ull;
+            hash = HashBytes(hash, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
+            hash = HashBytes(hash, cmdList->IdxBuffer.Data, cmdList->IdxBuffer.Size * sizeof(ImDrawIdx));
+            hash = HashBytes(hash, cmdList->CmdBuffer.Data, cmdList->CmdBuffer.Size * sizeof(ImDrawCmd));
+
+            DrawListState state{.hash = hash};
+            if (minX <= maxX && minY <= maxY)
+            {
+                // Pad by one pixel so that anti-aliased fringes are always covered
+                Rect bounds{
+                    static_cast<int32_t>(std::floor((minX - drawData->DisplayPos.x) * drawData->FramebufferScale.x)) - 1,
+                    static_cast<int32_t>(std::floor((minY - drawData->DisplayPos.y) * drawData->FramebufferScale.y)) - 1,
+                    static_cast<int32_t>(std::ceil((maxX - drawData->DisplayPos.x) * drawData->FramebufferScale.x)) + 1,
+                    static_cast<int32_t>(std::ceil((maxY - drawData->DisplayPos.y) * drawData->FramebufferScale.y)) + 1,
+                };
+                state.bounds = bounds.Intersect(m_framebufferRect);
+            }
+
+            if (static_cast<size_t>(i) >= m_previousLists.size())
+                damage = damage.Union(state.bounds);
+            else if (m_previousLists[i].hash != state.hash)
+                damage = damage.Union(m_previousLists[i].bounds).Union(state.bounds);
+
+            m_currentLists.push_back(state);
+        }
+        for (size_t i = m_currentLists.size(); i < m_previousLists.size(); ++i)
+            damage = damage.Union(m_previousLists[i].bounds);
+        m_previousLists.swap(m_currentLists);
+
+        if (0 == m_historyCount)
+            damage = m_framebufferRect; // History was invalidated, the whole framebuffer is stale
+        if (damage.IsEmpty())
+            return {};
+
+        // The back buffer misses the damage of the last (bufferAge - 1) presented frames
+        auto repaintRect = damage;
+        if (0 >= bufferAge || static_cast<size_t>(bufferAge - 1) > m_historyCount)
+            repaintRect = m_framebufferRect;
+        else
+        {
+            for (int i = 0; i < bufferAge - 1; ++i)
+                repaintRect = repaintRect.Union(m_history[i]);
+        }
+
+        std::move_backward(m_history.begin(), m_history.end() - 1, m_history.end());
+        m_history[0] = damage;
+        m_historyCount = std::min(m_historyCount + 1, MaxHistory);
+
+        return repaintRect;
+    }
+
+    void ADamageTracker::Invalidate()
+    {
+        m_previousLists.clear();
+        m_historyCount = 0;
+    }
+
+    void ADamageTracker::ClipDrawData(ImDrawData *drawData, const Rect &repaintRect)
+    {
+        ImVec4 clipRect{
+            repaintRect.left / drawData->FramebufferScale.x + drawData->DisplayPos.x,
+            repaintRect.top / drawData->FramebufferScale.y + drawData->DisplayPos.y,
+            repaintRect.right / drawData->FramebufferScale.x + drawData->DisplayPos.x,
+            repaintRect.bottom / drawData->FramebufferScale.y + drawData->DisplayPos.y,
+        };
+
+        for (auto cmdList : drawData->CmdLists)
+        {
+            for (auto &cmd : cmdList->CmdBuffer)
+            {
+                cmd.ClipRect.x = std::max(cmd.ClipRect.x, clipRect.x);
+                cmd.ClipRect.y = std::max(cmd.ClipRect.y, clipRect.y);
+                cmd.ClipRect.z = std::min(cmd.ClipRect.z, clipRect.z);
+                cmd.ClipRect.w = std::min(cmd.ClipRect.w, clipRect.w);
+            }
+        }
+    }
+}
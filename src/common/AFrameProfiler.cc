@@ -0,0 +1,374 @@
+#include "AFrameProfiler.h"
+
+#include "Global.h"
+
+#include <EGL/egl.h>
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+static int64_t GetMonotonicNanoseconds()
+{
+    timespec currentTimeSpec{};
+    clock_gettime(CLOCK_MONOTONIC, &currentTimeSpec);
+
+    return static_cast<int64_t>(currentTimeSpec.tv_sec) * 1000000000ll + currentTimeSpec.tv_nsec;
+}
+
+namespace android
+{
+    const char *AFrameProfiler::GetPhaseName(Phase phase)
+    {
+        constexpr const char *phaseNames[] = {
+            "BeginFrame",
+            "DisplayPoll",
+            "MirrorProcess",
+            "NewFrame",
+            "UserCode",
+            "Render",
+            "Serialize",
+            "Compress",
+            "Send",
+            "Receive",
+            "Decompress",
+            "Parse",
+            "Submit",
+            "Gpu",
+            "Swap",
+        };
+        static_assert(std::size(phaseNames) == PhaseCount);
+
+        return PhaseCount > static_cast<size_t>(phase) ? phaseNames[static_cast<size_t>(phase)] : "Unknown";
+    }
+
+    const char *AFrameProfiler::GetCounterName(Counter counter)
+    {
+        constexpr const char *counterNames[] = {
+            "FrameTime",
+            "FrameBytes",
+            "CompressionRatio",
+            "DrawCalls",
+            "InputLatency",
+        };
+        static_assert(std::size(counterNames) == CounterCount);
+
+        return CounterCount > static_cast<size_t>(counter) ? counterNames[static_cast<size_t>(counter)] : "Unknown";
+    }
+
+    void AFrameProfiler::Record(Phase phase, float milliseconds)
+    {
+        RecordSeries(static_cast<size_t>(phase), milliseconds);
+    }
+
+    void AFrameProfiler::Record(Phase phase, std::chrono::steady_clock::time_point start)
+    {
+        Record(phase, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void AFrameProfiler::Record(Counter counter, float value)
+    {
+        RecordSeries(PhaseCount + static_cast<size_t>(counter), value);
+    }
+
+    size_t AFrameProfiler::ReadSamples(Phase phase, float *samples, size_t maxCount) const
+    {
+        return ReadSeries(static_cast<size_t>(phase), samples, maxCount);
+    }
+
+    size_t AFrameProfiler::ReadSamples(Counter counter, float *samples, size_t maxCount) const
+    {
+        return ReadSeries(PhaseCount + static_cast<size_t>(counter), samples, maxCount);
+    }
+
+    AFrameProfiler::Statistics AFrameProfiler::GetStatistics(Phase phase) const
+    {
+        return GetSeriesStatistics(static_cast<size_t>(phase));
+    }
+
+    AFrameProfiler::Statistics AFrameProfiler::GetStatistics(Counter counter) const
+    {
+        return GetSeriesStatistics(PhaseCount + static_cast<size_t>(counter));
+    }
+
+    void AFrameProfiler::Reset()
+    {
+        for (auto &series : m_series)
+            series.writeCount.store(0, std::memory_order_release);
+        m_droppedFrames.store(0, std::memory_order_relaxed);
+        for (auto &bucket : m_latencyBuckets)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+
+    void AFrameProfiler::AddDroppedFrame()
+    {
+        m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t AFrameProfiler::GetDroppedFrames() const
+    {
+        return m_droppedFrames.load(std::memory_order_relaxed);
+    }
+
+    void AFrameProfiler::MarkInput(int64_t eventNanoseconds)
+    {
+        if (0 >= eventNanoseconds)
+            return;
+
+        // Keep the oldest input of the frame
+        auto pending = m_inputNanoseconds.load(std::memory_order_relaxed);
+        while ((0 == pending || eventNanoseconds < pending) && !m_inputNanoseconds.compare_exchange_weak(pending, eventNanoseconds, std::memory_order_relaxed))
+            ;
+    }
+
+    int64_t AFrameProfiler::TakeInput()
+    {
+        return m_inputNanoseconds.exchange(0, std::memory_order_relaxed);
+    }
+
+    void AFrameProfiler::BeginPresent()
+    {
+        if (!m_presentTimerSupported)
+            return;
+
+        CollectPresentTimes();
+        m_nextFrameIdValid = EGL_TRUE == m_eglGetNextFrameId(m_presentDisplay, m_presentSurface, &m_nextFrameId);
+    }
+
+    void AFrameProfiler::MarkPresent()
+    {
+        auto inputNanoseconds = TakeInput();
+        if (0 == inputNanoseconds)
+            return;
+
+        auto now = GetMonotonicNanoseconds();
+        if (!m_presentTimerSupported || !m_nextFrameIdValid)
+        {
+            RecordInputLatency(now - inputNanoseconds);
+            return;
+        }
+
+        // A frame still pending after PresentQueryCount swaps falls back to its swap time
+        auto &pendingPresent = m_pendingPresents[m_pendingPresentIndex];
+        if (pendingPresent.pending)
+            RecordInputLatency(pendingPresent.swapNanoseconds - pendingPresent.inputNanoseconds);
+        pendingPresent = {true, m_nextFrameId, inputNanoseconds, now};
+        m_pendingPresentIndex = (m_pendingPresentIndex + 1) % PresentQueryCount;
+        m_nextFrameIdValid = false;
+    }
+
+    AFrameProfiler::LatencyHistogram AFrameProfiler::GetInputLatencyHistogram() const
+    {
+        LatencyHistogram histogram{};
+
+        for (size_t i = 0; i < LatencyHistogram::BucketCount; ++i)
+        {
+            histogram.counts[i] = m_latencyBuckets[i].load(std::memory_order_relaxed);
+            histogram.totalCount += histogram.counts[i];
+        }
+
+        return histogram;
+    }
+
+    void AFrameProfiler::RecordInputLatency(int64_t nanoseconds)
+    {
+        if (0 > nanoseconds)
+            return;
+
+        auto milliseconds = nanoseconds / 1000000.f;
+        auto bucket = std::min(static_cast<size_t>(milliseconds / LatencyHistogram::BucketMilliseconds), LatencyHistogram::BucketCount - 1);
+
+        Record(Counter::InputLatency, milliseconds);
+        m_latencyBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AFrameProfiler::RecordSeries(size_t series, float value)
+    {
+        auto &samples = m_series[series];
+        auto writeIndex = samples.writeCount.load(std::memory_order_relaxed);
+
+        samples.samples[writeIndex % SampleCount].store(value, std::memory_order_relaxed);
+        samples.writeCount.store(writeIndex + 1, std::memory_order_release);
+    }
+
+    size_t AFrameProfiler::ReadSeries(size_t series, float *samples, size_t maxCount) const
+    {
+        const auto &source = m_series[series];
+        auto writeCount = source.writeCount.load(std::memory_order_acquire);
+        auto count = std::min({static_cast<size_t>(writeCount), SampleCount, maxCount});
+
+        for (size_t i = 0; i < count; ++i)
+            samples[i] = source.samples[(writeCount - count + i) % SampleCount].load(std::memory_order_relaxed);
+
+        return count;
+    }
+
+    AFrameProfiler::Statistics AFrameProfiler::GetSeriesStatistics(size_t series) const
+    {
+        std::array<float, SampleCount> samples{};
+        Statistics statistics{};
+
+        statistics.sampleCount = ReadSeries(series, samples.data(), samples.size());
+        if (0 == statistics.sampleCount)
+            return statistics;
+
+        statistics.last = samples[statistics.sampleCount - 1];
+        for (size_t i = 0; i < statistics.sampleCount; ++i)
+            statistics.average += samples[i];
+        statistics.average /= statistics.sampleCount;
+
+        std::sort(samples.begin(), samples.begin() + statistics.sampleCount);
+        auto percentile = [&](float fraction)
+        {
+            return samples[static_cast<size_t>(fraction * (statistics.sampleCount - 1) + 0.5f)];
+        };
+        statistics.p50 = percentile(0.50f);
+        statistics.p95 = percentile(0.95f);
+        statistics.p99 = percentile(0.99f);
+
+        return statistics;
+    }
+
+    bool AFrameProfiler::InitGpuTimer()
+    {
+        if (m_gpuTimerSupported)
+            return true;
+
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount && !m_gpuTimerSupported; ++i)
+        {
+            auto extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+            m_gpuTimerSupported = nullptr != extension && 0 == strcmp(extension, "GL_EXT_disjoint_timer_query");
+        }
+        if (!m_gpuTimerSupported)
+        {
+            LogInfo("[=] GPU timer queries unsupported, GPU phase is not recorded");
+            return false;
+        }
+
+        m_glGetQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(eglGetProcAddress("glGetQueryObjectui64vEXT"));
+        if (nullptr == m_glGetQueryObjectui64v)
+        {
+            m_gpuTimerSupported = false;
+            return false;
+        }
+
+        glGenQueries(GpuQueryCount, m_gpuQueries.data());
+        m_gpuQueryPending.fill(false);
+        m_gpuQueryIndex = 0;
+        m_gpuQueryActive = false;
+
+        return true;
+    }
+
+    void AFrameProfiler::ShutdownGpuTimer()
+    {
+        if (!m_gpuTimerSupported)
+            return;
+
+        if (m_gpuQueryActive)
+            glEndQuery(GL_TIME_ELAPSED_EXT);
+        glDeleteQueries(GpuQueryCount, m_gpuQueries.data());
+        m_gpuQueries.fill(0);
+        m_gpuTimerSupported = false;
+        m_gpuQueryActive = false;
+    }
+
+    void AFrameProfiler::BeginGpuTimer()
+    {
+        if (!m_gpuTimerSupported || m_gpuQueryActive)
+            return;
+
+        CollectGpuTimers();
+
+        // Every query is still in flight, skip timing this frame rather than waiting on the GPU
+        if (m_gpuQueryPending[m_gpuQueryIndex])
+            return;
+
+        glBeginQuery(GL_TIME_ELAPSED_EXT, m_gpuQueries[m_gpuQueryIndex]);
+        m_gpuQueryActive = true;
+    }
+
+    void AFrameProfiler::EndGpuTimer()
+    {
+        if (!m_gpuQueryActive)
+            return;
+
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        m_gpuQueryPending[m_gpuQueryIndex] = true;
+        m_gpuQueryIndex = (m_gpuQueryIndex + 1) % GpuQueryCount;
+        m_gpuQueryActive = false;
+    }
+
+    void AFrameProfiler::CollectGpuTimers()
+    {
+        // A disjoint event (frequency change, context loss) makes every pending result meaningless
+        GLint disjoint = 0;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+        for (size_t i = 0; i < GpuQueryCount; ++i)
+        {
+            auto queryIndex = (m_gpuQueryIndex + i) % GpuQueryCount;
+            if (!m_gpuQueryPending[queryIndex])
+                continue;
+
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(m_gpuQueries[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (GL_TRUE != available)
+                continue;
+
+            GLuint64 elapsedNanoseconds = 0;
+            m_glGetQueryObjectui64v(m_gpuQueries[queryIndex], GL_QUERY_RESULT, &elapsedNanoseconds);
+            m_gpuQueryPending[queryIndex] = false;
+            if (0 == disjoint)
+                Record(Phase::Gpu, elapsedNanoseconds / 1000000.f);
+        }
+    }
+    bool AFrameProfiler::InitPresentTimer(EGLDisplay display, EGLSurface surface)
+    {
+        m_eglGetNextFrameId = reinterpret_cast<PFNEGLGETNEXTFRAMEIDANDROIDPROC>(eglGetProcAddress("eglGetNextFrameIdANDROID"));
+        m_eglGetFrameTimestamps = reinterpret_cast<PFNEGLGETFRAMETIMESTAMPSANDROIDPROC>(eglGetProcAddress("eglGetFrameTimestampsANDROID"));
+        if (nullptr == m_eglGetNextFrameId || nullptr == m_eglGetFrameTimestamps || EGL_TRUE != eglSurfaceAttrib(display, surface, EGL_TIMESTAMPS_ANDROID, EGL_TRUE))
+        {
+            LogInfo("[=] EGL frame timestamps unavailable, input latency ends at the swap");
+            return false;
+        }
+
+        m_presentDisplay = display;
+        m_presentSurface = surface;
+        m_pendingPresents.fill({});
+        m_pendingPresentIndex = 0;
+        m_nextFrameIdValid = false;
+        m_presentTimerSupported = true;
+
+        return true;
+    }
+
+    void AFrameProfiler::ShutdownPresentTimer()
+    {
+        m_presentTimerSupported = false;
+        m_presentDisplay = EGL_NO_DISPLAY;
+        m_presentSurface = EGL_NO_SURFACE;
+    }
+
+    void AFrameProfiler::CollectPresentTimes()
+    {
+        constexpr EGLint timestampNames[] = {EGL_DISPLAY_PRESENT_TIME_ANDROID};
+
+        for (auto &pendingPresent : m_pendingPresents)
+        {
+            if (!pendingPresent.pending)
+                continue;
+
+            EGLnsecsANDROID presentNanoseconds = EGL_TIMESTAMP_INVALID_ANDROID;
+            if (EGL_TRUE != m_eglGetFrameTimestamps(m_presentDisplay, m_presentSurface, pendingPresent.frameId, 1, timestampNames, &presentNanoseconds))
+                presentNanoseconds = EGL_TIMESTAMP_INVALID_ANDROID;
+            if (EGL_TIMESTAMP_PENDING_ANDROID == presentNanoseconds)
+                continue;
+
+            RecordInputLatency((0 < presentNanoseconds ? presentNanoseconds : pendingPresent.swapNanoseconds) - pendingPresent.inputNanoseconds);
+            pendingPresent.pending = false;
+        }
+    }
+}
@@ -3,10 +3,18 @@
 #include "Global.h"
 #include "ANativeWindowCreator.h"
 #include "ATouchEvent.h"
+#include "ATracer.h"
 
+#include <imgui/imgui_internal.h>
 #include <ImGui-SharedDrawData/modules/ImGuiSharedDrawData.h>
 #include <zstd.h>
 
+#include <string_view>
+#include <future>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
 size_t android::anative_window_creator::detail::compat::SystemVersion = 13;
 
 static ImGuiKey KeyCodeToImGuiKey(int32_t keyCode)
@@ -369,10 +377,26 @@ static unsigned int KeyCodeToCharacter(int32_t keyCode, bool upperCase)
     }
 }
 
+static bool HasEglExtension(const char *extensions, std::string_view name)
+{
+    if (nullptr == extensions)
+        return false;
+
+    std::string_view extensionsView{extensions};
+    for (auto position = extensionsView.find(name); std::string_view::npos != position; position = extensionsView.find(name, position + 1))
+    {
+        auto end = position + name.size();
+        if ((0 == position || ' ' == extensionsView[position - 1]) && (extensionsView.size() == end || ' ' == extensionsView[end]))
+            return true;
+    }
+
+    return false;
+}
+
 namespace android
 {
     AImGui::AImGui(const Options &options)
-        : m_options(options)
+        : m_options(options), m_touchResampler(options.touchResampler), m_performanceOverlayVisible(options.performanceOverlay)
     {
         InitEnvironment();
     }
@@ -387,23 +411,37 @@ namespace android
         if (!m_state)
             return;
 
+        AIMGUI_TRACE_SCOPE("AImGui::BeginFrame");
+        AFrameProfiler::ScopedTimer beginFrameTimer(m_frameProfiler, AFrameProfiler::Phase::BeginFrame);
+        auto phaseStart = std::chrono::steady_clock::now();
         if (m_options.autoUpdateOrientation)
         {
-            auto displayInfo = ANativeWindowCreator::GetDisplayInfo();
+            auto displayInfo = ANativeWindowCreator::GetCachedDisplayInfo();
 
             // Check if display orientation is changed
             if (m_rotateTheta != displayInfo.theta)
-            {
-                UnInitEnvironment();
-                InitEnvironment();
-            }
+                ResizeEnvironment(displayInfo.theta, displayInfo.width, displayInfo.height);
         }
+        m_frameProfiler.Record(AFrameProfiler::Phase::DisplayPoll, phaseStart);
 
+        // Surface changes made during the frame reach SurfaceFlinger with one apply in EndFrame
+        phaseStart = std::chrono::steady_clock::now();
+        if (RenderType::RenderClient != m_options.renderType)
+            ANativeWindowCreator::BeginTransactionBatch();
         ANativeWindowCreator::ProcessMirrorDisplay();
+        m_frameProfiler.Record(AFrameProfiler::Phase::MirrorProcess, phaseStart);
 
-        ImGui_ImplOpenGL3_NewFrame();
+        phaseStart = std::chrono::steady_clock::now();
         if (RenderType::RenderClient != m_options.renderType)
+        {
             ImGui_ImplAndroid_NewFrame();
+
+            // The window buffer may be smaller than the screen, the ui still lays out against the whole screen
+            auto &imguiIO = ImGui::GetIO();
+
+            imguiIO.DisplaySize = {static_cast<float>(m_screenWidth), static_cast<float>(m_screenHeight)};
+            imguiIO.DisplayFramebufferScale = {m_options.renderScale, m_options.renderScale};
+        }
         else
         {
             // Copy from imgui_impl_android.cpp
@@ -419,24 +457,55 @@ namespace android
             m_lastTime = currentTime;
         }
         if (RenderType::RenderClient == m_options.renderType || RenderType::RenderNative == m_options.renderType)
+        {
+            DispatchInputEvents();
             ImGui::NewFrame();
+            ApplyPinchZoom();
+        }
+        m_frameProfiler.Record(AFrameProfiler::Phase::NewFrame, phaseStart);
+
+        m_userCodeStart = std::chrono::steady_clock::now();
     }
     void AImGui::EndFrame()
     {
         if (!m_state)
             return;
 
+        AIMGUI_TRACE_SCOPE("AImGui::EndFrame");
+        if (std::chrono::steady_clock::time_point{} != m_userCodeStart)
+            m_frameProfiler.Record(AFrameProfiler::Phase::UserCode, m_userCodeStart);
+
+        // Only the native and client modes build their own ImGui frame
+        if (RenderType::RenderServer != m_options.renderType)
+        {
+            const auto &imguiIO = ImGui::GetIO();
+
+            if (imguiIO.KeyCtrl && imguiIO.KeyShift && ImGui::IsKeyPressed(ImGuiKey_P, false))
+                m_performanceOverlayVisible = !m_performanceOverlayVisible;
+            if (m_performanceOverlayVisible)
+                DrawPerformanceOverlay();
+        }
+
         if (RenderType::RenderClient == m_options.renderType)
         {
+            auto phaseStart = std::chrono::steady_clock::now();
             ImGui::Render();
+            m_frameProfiler.Record(AFrameProfiler::Phase::Render, phaseStart);
+
+            phaseStart = std::chrono::steady_clock::now();
             const auto &sharedData = ImGui::GetSharedDrawData();
+            m_frameProfiler.Record(AFrameProfiler::Phase::Serialize, phaseStart);
             if (!sharedData.empty())
             {
                 if (!m_options.compressionFrameData)
                 {
+                    AFrameProfiler::ScopedTimer sendTimer(m_frameProfiler, AFrameProfiler::Phase::Send);
                     uint32_t packetSize = static_cast<uint32_t>(sharedData.size());
+                    int64_t inputNanoseconds = m_frameProfiler.TakeInput();
                     WriteData(&packetSize, sizeof(packetSize));
+                    WriteData(&inputNanoseconds, sizeof(inputNanoseconds));
                     WriteData(const_cast<uint8_t *>(sharedData.data()), sharedData.size());
+                    m_frameProfiler.Record(AFrameProfiler::Counter::FrameBytes, static_cast<float>(sizeof(packetSize) + sizeof(inputNanoseconds) + packetSize));
                 }
                 else
                 {
@@ -459,13 +528,25 @@ namespace android
 
                     ZSTD_inBuffer input = {sharedData.data(), sharedData.size(), 0};
                     ZSTD_outBuffer output = {compressBuffer.data(), compressBuffer.size(), 0};
-                    if (0 == ZSTD_compressStream2(compressContext.get(), &output, &input, ZSTD_e_end))
+                    size_t compressResult = 0;
+                    phaseStart = std::chrono::steady_clock::now();
+                    {
+                        AIMGUI_TRACE_SCOPE("ZSTD_compressStream2");
+                        compressResult = ZSTD_compressStream2(compressContext.get(), &output, &input, ZSTD_e_end);
+                    }
+                    m_frameProfiler.Record(AFrameProfiler::Phase::Compress, phaseStart);
+                    if (0 == compressResult)
                     {
+                        AFrameProfiler::ScopedTimer sendTimer(m_frameProfiler, AFrameProfiler::Phase::Send);
                         uint32_t packetSize = sizeof(uint32_t) + output.pos;
+                        int64_t inputNanoseconds = m_frameProfiler.TakeInput();
                         WriteData(&packetSize, sizeof(packetSize));
+                        WriteData(&inputNanoseconds, sizeof(inputNanoseconds));
                         uint32_t sharedDataSize = sharedData.size();
                         WriteData(&sharedDataSize, sizeof(sharedDataSize));
                         WriteData(compressBuffer.data(), output.pos);
+                        m_frameProfiler.Record(AFrameProfiler::Counter::FrameBytes, static_cast<float>(sizeof(packetSize) + sizeof(inputNanoseconds) + packetSize));
+                        m_frameProfiler.Record(AFrameProfiler::Counter::CompressionRatio, static_cast<float>(sharedData.size()) / std::max<size_t>(1, output.pos));
                     }
                     else
                         LogDebug("[-] Client compression frame data error");
@@ -484,30 +565,29 @@ namespace android
                     break;
                 }
 
-                ImGui_ImplOpenGL3_DestroyFontsTexture();
+                m_renderer.DestroyFontsTexture();
                 ImGui::SetSharedFontData(m_serverFontData);
-                ImGui_ImplOpenGL3_CreateFontsTexture();
+                m_renderer.CreateFontsTexture();
                 m_renderState = RenderState::ReadData;
 
                 break;
             }
             case RenderState::Rendering:
             {
+                auto phaseStart = std::chrono::steady_clock::now();
                 auto drawData = ImGui::RenderSharedDrawData(m_serverRenderData);
+                m_frameProfiler.Record(AFrameProfiler::Phase::Parse, phaseStart);
                 if (nullptr != drawData)
                 {
-                    if (m_options.exchangeFontData)
+                    // The client has no GL context, its texture ids never name a texture of ours
+                    for (const auto &cmdList : drawData->CmdLists)
                     {
-                        for (const auto &cmdList : drawData->CmdLists)
-                        {
-                            for (auto &cmd : cmdList->CmdBuffer)
-                                cmd.TextureId = ImGui::GetIO().Fonts->TexID;
-                        }
+                        for (auto &cmd : cmdList->CmdBuffer)
+                            cmd.TextureId = ImGui::GetIO().Fonts->TexID;
                     }
 
-                    glClear(GL_COLOR_BUFFER_BIT);
-                    ImGui_ImplOpenGL3_RenderDrawData(drawData);
-                    eglSwapBuffers(m_defaultDisplay, m_eglSurface);
+                    m_frameProfiler.MarkInput(m_serverInputNanoseconds);
+                    PresentDrawData(drawData, m_screenWidth, m_screenHeight);
                 }
                 m_renderState = RenderState::ReadData;
 
@@ -519,26 +599,49 @@ namespace android
         }
         else if (RenderType::RenderNative == m_options.renderType)
         {
+            auto phaseStart = std::chrono::steady_clock::now();
             ImGui::Render();
-            glClear(GL_COLOR_BUFFER_BIT);
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-            eglSwapBuffers(m_defaultDisplay, m_eglSurface);
+            m_frameProfiler.Record(AFrameProfiler::Phase::Render, phaseStart);
+            if (m_renderThread)
+                SubmitDrawData(ImGui::GetDrawData());
+            else
+                PresentDrawData(ImGui::GetDrawData(), m_screenWidth, m_screenHeight);
+        }
+
+        if (RenderType::RenderClient != m_options.renderType)
+            ANativeWindowCreator::ApplyTransactionBatch();
+
+        if (0.f > m_firstFrameMilliseconds)
+        {
+            std::lock_guard lock(m_startupMutex);
+
+            m_firstFrameMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_startupStart).count();
+            LogInfo("[+] First frame ended %.2fms after startup began", m_firstFrameMilliseconds);
         }
+
+        auto frameEnd = std::chrono::steady_clock::now();
+        if (std::chrono::steady_clock::time_point{} != m_lastEndFrame)
+            m_frameProfiler.Record(AFrameProfiler::Counter::FrameTime, std::chrono::duration<float, std::milli>(frameEnd - m_lastEndFrame).count());
+        m_lastEndFrame = frameEnd;
     }
 
     void AImGui::ProcessInputEvent()
     {
-        static ATouchEvent::TouchEvent event{};
+        WaitInputEvent(0);
+    }
+
+    bool AImGui::WaitInputEvent(int timeoutMilliseconds)
+    {
+        ATouchEvent::TouchEvent event{};
 
         if (!m_state)
-            return;
+            return false;
 
+        AIMGUI_TRACE_SCOPE("AImGui::WaitInputEvent");
         if (RenderType::RenderServer == m_options.renderType || RenderType::RenderNative == m_options.renderType)
         {
-            static ATouchEvent touchEvent;
-
-            if (!touchEvent.GetTouchEvent(&event))
-                return;
+            if (nullptr == m_touchEvent || !m_touchEvent->WaitTouchEvent(&event, timeoutMilliseconds))
+                return false;
             event.TransformToScreen(m_screenWidth, m_screenHeight, m_rotateTheta);
 
             if (RenderType::RenderServer == m_options.renderType)
@@ -546,27 +649,84 @@ namespace android
         }
         else
         {
+            // Sleep until the server forwards an event or InterruptInputEvent is called
+            pollfd pollFds[] = {
+                {.fd = m_clientFd, .events = POLLIN},
+                {.fd = m_inputWakeFd, .events = POLLIN},
+            };
+            if (0 >= poll(pollFds, std::size(pollFds), timeoutMilliseconds))
+                return false;
+            if (pollFds[1].revents & POLLIN)
+            {
+                eventfd_t value = 0;
+                eventfd_read(m_inputWakeFd, &value);
+                return false;
+            }
+
             auto readResult = ReadData(&event, sizeof(event));
             if (0 >= readResult)
             {
                 // LogDebug("[-] Client can not read input event, readResult:%d  %d:%s", readResult, errno, strerror(errno));
-                return;
+                return false;
             }
         }
 
+        // ImGuiIO belongs to the ui thread, BeginFrame hands the event to it
         if (RenderType::RenderClient == m_options.renderType || RenderType::RenderNative == m_options.renderType)
+            m_inputQueue.Push(event);
+
+        return true;
+    }
+
+    void AImGui::InterruptInputEvent()
+    {
+        if (nullptr != m_touchEvent)
+            m_touchEvent->Interrupt();
+        if (-1 != m_inputWakeFd)
+            eventfd_write(m_inputWakeFd, 1);
+    }
+
+    void AImGui::DispatchInputEvents()
+    {
+        std::array<AInputQueue::Entry, AInputQueue::Capacity> entries;
+        auto &imguiIO = ImGui::GetIO();
+
+        auto entryCount = m_inputQueue.Drain(entries.data(), entries.size());
+        bool dragMoved = false;
+        for (size_t i = 0; i < entryCount; ++i)
         {
-            auto &imguiIO = ImGui::GetIO();
+            const auto &entry = entries[i];
+            const auto &event = entry.event;
+
+            m_frameProfiler.MarkInput(entry.oldestNanoseconds);
             switch (event.type)
             {
             case ATouchEvent::EventType::Move:
             {
+                // The position of a drag is sent once every event is handled, resampled to the present time
+                if (m_options.touchResampling && m_touchPointerDown)
+                {
+                    // A slow frame collapses several reports, the last two still give the velocity
+                    if (1 < entry.moveCount)
+                        m_touchResampler.AddSample(entry.previousMove.timestampNanoseconds, entry.previousMove.x, entry.previousMove.y);
+                    m_touchResampler.AddSample(event.timestampNanoseconds, event.x, event.y);
+                    dragMoved = true;
+                    break;
+                }
+
                 imguiIO.AddMousePosEvent(event.x, event.y);
                 break;
             }
             case ATouchEvent::EventType::TouchDown:
             case ATouchEvent::EventType::TouchUp:
             {
+                m_touchPointerDown = ATouchEvent::EventType::TouchDown == event.type;
+                m_touchPointerPredicted = false;
+                dragMoved = false;
+                m_touchResampler.Reset();
+                if (m_touchPointerDown)
+                    m_touchResampler.AddSample(event.timestampNanoseconds, event.x, event.y);
+
                 imguiIO.AddMousePosEvent(event.x, event.y);
                 imguiIO.AddMouseButtonEvent(0, ATouchEvent::EventType::TouchDown == event.type);
                 break;
@@ -582,11 +742,13 @@ namespace android
                 {
                 case ImGuiKey_LeftCtrl:
                 case ImGuiKey_RightCtrl:
-                    imguiIO.AddKeyEvent(ImGuiMod_Ctrl, ATouchEvent::EventType::KeyDown == event.type);
+                    m_inputCtrlDown = ATouchEvent::EventType::KeyDown == event.type;
+                    imguiIO.AddKeyEvent(ImGuiMod_Ctrl, m_inputCtrlDown);
                     break;
                 case ImGuiKey_LeftShift:
                 case ImGuiKey_RightShift:
-                    imguiIO.AddKeyEvent(ImGuiMod_Shift, ATouchEvent::EventType::KeyDown == event.type);
+                    m_inputShiftDown = ATouchEvent::EventType::KeyDown == event.type;
+                    imguiIO.AddKeyEvent(ImGuiMod_Shift, m_inputShiftDown);
                     break;
                 case ImGuiKey_LeftAlt:
                 case ImGuiKey_RightAlt:
@@ -600,7 +762,7 @@ namespace android
 
                 if (ATouchEvent::EventType::KeyDown != event.type)
                     break;
-                unsigned int character = KeyCodeToCharacter(event.keyCode, ImGui::IsKeyDown(ImGuiMod_Shift));
+                unsigned int character = KeyCodeToCharacter(event.keyCode, m_inputShiftDown);
                 if (imguiIO.WantTextInput && 0 != character)
                     imguiIO.AddInputCharacter(character);
                 break;
@@ -611,10 +773,69 @@ namespace android
                 imguiIO.AddMouseWheelEvent(0, 0 > event.x ? -1 : 1);
                 break;
             }
+            case ATouchEvent::EventType::Scroll:
+            {
+                // ImGui scrolls five lines per wheel step, this keeps the content under the fingers
+                auto wheelPixels = 5.f * std::max(ImGui::GetFontSize(), 1.f);
+
+                imguiIO.AddMousePosEvent(event.x, event.y);
+                imguiIO.AddMouseWheelEvent(event.deltaX / wheelPixels, event.deltaY / wheelPixels);
+                break;
+            }
+            case ATouchEvent::EventType::Pinch:
+            {
+                // Applied to the window under the fingers once NewFrame found it
+                imguiIO.AddMousePosEvent(event.x, event.y);
+                m_pinchScale *= event.scale;
+                break;
+            }
             default:
                 break;
             }
         }
+
+        // Without new reports the finger stopped, move the pointer back from the predicted position
+        if (!dragMoved && !m_touchPointerPredicted)
+            return;
+
+        float x = 0.f, y = 0.f;
+        if (dragMoved)
+        {
+            timespec currentTimeSpec{};
+            float frameMilliseconds = 0.f;
+            clock_gettime(CLOCK_MONOTONIC, &currentTimeSpec);
+            m_frameProfiler.ReadSamples(AFrameProfiler::Counter::FrameTime, &frameMilliseconds, 1);
+
+            // The frame begun now is expected on screen about one frame time later
+            auto targetNanoseconds = static_cast<int64_t>(currentTimeSpec.tv_sec) * 1000000000ll + currentTimeSpec.tv_nsec + static_cast<int64_t>(frameMilliseconds * 1000000.f);
+            m_touchResampler.Resample(targetNanoseconds, &x, &y);
+        }
+        else
+            m_touchResampler.Resample(0, &x, &y);
+        imguiIO.AddMousePosEvent(x, y);
+        m_touchPointerPredicted = dragMoved;
+    }
+
+    void AImGui::ApplyPinchZoom()
+    {
+        auto scale = m_pinchScale;
+        m_pinchScale = 1.f;
+
+        auto hoveredWindow = ImGui::GetCurrentContext()->HoveredWindow;
+        if (1.f == scale || nullptr == hoveredWindow)
+            return;
+
+        // The zoom ImGui does for Ctrl+wheel with FontAllowUserScaling, kept to the pinched window
+        auto window = hoveredWindow->RootWindow;
+        auto fontScale = std::clamp(window->FontWindowScale * scale, 0.5f, 2.5f);
+        scale = fontScale / window->FontWindowScale;
+        window->FontWindowScale = fontScale;
+
+        // The point between the fingers stays in place
+        auto pivot = ImGui::GetIO().MousePos;
+        ImGui::SetWindowPos(window, {pivot.x + (window->Pos.x - pivot.x) * scale, pivot.y + (window->Pos.y - pivot.y) * scale}, ImGuiCond_Always);
+        window->Size = {std::floor(window->Size.x * scale), std::floor(window->Size.y * scale)};
+        window->SizeFull = {std::floor(window->SizeFull.x * scale), std::floor(window->SizeFull.y * scale)};
     }
 
     void AImGui::SetupWindowInfo(void *windowInfo)
@@ -622,9 +843,53 @@ namespace android
         ANativeWindowCreator::UpdateWindowInfo(m_nativeWindow, windowInfo);
     }
 
+    std::vector<AImGui::StartupPhase> AImGui::GetStartupPhases() const
+    {
+        std::lock_guard lock(m_startupMutex);
+
+        return m_startupPhases;
+    }
+
+    float AImGui::GetStartupMilliseconds() const
+    {
+        std::lock_guard lock(m_startupMutex);
+
+        return m_startupMilliseconds;
+    }
+
+    float AImGui::GetFirstFrameMilliseconds() const
+    {
+        std::lock_guard lock(m_startupMutex);
+
+        return m_firstFrameMilliseconds;
+    }
+
+    void AImGui::RecordStartupPhase(const char *name, std::chrono::steady_clock::time_point phaseStart)
+    {
+        auto phaseEnd = std::chrono::steady_clock::now();
+        std::lock_guard lock(m_startupMutex);
+
+        m_startupPhases.push_back({
+            .name = name,
+            .startMilliseconds = std::chrono::duration<float, std::milli>(phaseStart - m_startupStart).count(),
+            .durationMilliseconds = std::chrono::duration<float, std::milli>(phaseEnd - phaseStart).count(),
+        });
+    }
+
     bool AImGui::InitEnvironment()
     {
+        {
+            std::lock_guard lock(m_startupMutex);
+
+            m_startupStart = std::chrono::steady_clock::now();
+            m_startupPhases.clear();
+            m_startupMilliseconds = 0.f;
+            m_firstFrameMilliseconds = -1.f;
+        }
+        auto phaseStart = m_startupStart;
+
         // Initialize rpc
+        std::future<bool> connectTask;
         m_transportAddress.sin_family = AF_INET;
         m_transportAddress.sin_port = htons(16888);
         if (RenderType::RenderClient == m_options.renderType)
@@ -638,11 +903,21 @@ namespace android
                 return false;
             }
 
-            if (0 > connect(m_clientFd, reinterpret_cast<sockaddr *>(&m_transportAddress), sizeof(m_transportAddress)))
-            {
-                LogDebug("[-] Client connect to server failed, %d:%s", errno, strerror(errno));
-                return false;
-            }
+            // The handshake overlaps the display query and the font atlas build
+            connectTask = std::async(std::launch::async,
+                [this]()
+                {
+                    auto connectStart = std::chrono::steady_clock::now();
+
+                    if (0 > connect(m_clientFd, reinterpret_cast<sockaddr *>(&m_transportAddress), sizeof(m_transportAddress)))
+                    {
+                        LogDebug("[-] Client connect to server failed, %d:%s", errno, strerror(errno));
+                        return false;
+                    }
+                    RecordStartupPhase("Connect", connectStart);
+
+                    return true;
+                });
         }
         else if (RenderType::RenderServer == m_options.renderType)
         {
@@ -674,16 +949,106 @@ namespace android
             }
 
             m_serverWorkerThread = std::make_unique<std::thread>(&AImGui::ServerWorker, this);
+            RecordStartupPhase("Listen", phaseStart);
+        }
+
+        // eglInitialize loads the GPU driver, it does not need the window and runs while the surface is created
+        std::future<bool> eglDisplayTask;
+        if (RenderType::RenderClient != m_options.renderType)
+        {
+            eglDisplayTask = std::async(std::launch::async,
+                [this]()
+                {
+                    auto eglStart = std::chrono::steady_clock::now();
+
+                    m_defaultDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+                    if (EGL_NO_DISPLAY == m_defaultDisplay)
+                    {
+                        LogDebug("[-] EGL get default display failed: %d", eglGetError());
+                        return false;
+                    }
+
+                    if (EGL_TRUE != eglInitialize(m_defaultDisplay, 0, 0))
+                    {
+                        LogDebug("[-] EGL initialize failed: %d", eglGetError());
+                        return false;
+                    }
+                    RecordStartupPhase("EGL initialize", eglStart);
+
+                    return true;
+                });
+        }
+
+        m_options.renderScale = std::clamp(m_options.renderScale, 0.1f, 1.f);
+
+        struct SurfaceFormatInfo
+        {
+            const char *name;
+            anative_window_creator::detail::types::PixelFormat pixelFormat;
+            EGLint redSize, greenSize, blueSize, alphaSize;
+        };
+        constexpr SurfaceFormatInfo surfaceFormats[] = {
+            {"RGBA8888", anative_window_creator::detail::types::PixelFormat::RGBA_8888, 8, 8, 8, 8},
+            {"RGBA4444", anative_window_creator::detail::types::PixelFormat::RGBA_4444, 4, 4, 4, 4},
+            {"RGB565", anative_window_creator::detail::types::PixelFormat::RGB_565, 5, 6, 5, 0},
+        };
+        const auto &surfaceFormat = surfaceFormats[static_cast<size_t>(m_options.surfaceFormat)];
+
+        // ImGui initialization, the font atlas is rasterized on its own task while the surface comes up
+        phaseStart = std::chrono::steady_clock::now();
+        IMGUI_CHECKVERSION();
+
+        m_imguiContext = ImGui::CreateContext();
+        if (nullptr == m_imguiContext)
+        {
+            LogDebug("[-] ImGui create context failed");
+            return false;
         }
 
+        auto &imguiIO = ImGui::GetIO();
+
+        imguiIO.IniFilename = nullptr;
+        ImGui::StyleColorsDark();
+        ImGui::GetStyle().ScaleAllSizes(3.f);
+
+        ImFontConfig fontConfig;
+        fontConfig.SizePixels = 22.f;
+        imguiIO.Fonts->AddFontDefault(&fontConfig);
+        RecordStartupPhase("ImGui context", phaseStart);
+
+        auto fontTask = std::async(std::launch::async,
+            [this, fontAtlas = imguiIO.Fonts]()
+            {
+                auto fontStart = std::chrono::steady_clock::now();
+                unsigned char *fontPixels = nullptr;
+                int fontWidth = 0, fontHeight = 0;
+
+                // Without a renderer backend the atlas is built on the CPU only, the server owns the real texture
+                if (RenderType::RenderClient == m_options.renderType)
+                    fontAtlas->GetTexDataAsAlpha8(&fontPixels, &fontWidth, &fontHeight);
+                else
+                    fontAtlas->GetTexDataAsRGBA32(&fontPixels, &fontWidth, &fontHeight);
+                RecordStartupPhase("Font atlas", fontStart);
+                LogInfo("[=] Font atlas built: %dx%d", fontWidth, fontHeight);
+            });
+
         // Initialize display orientation
+        phaseStart = std::chrono::steady_clock::now();
         auto displayInfo = ANativeWindowCreator::GetDisplayInfo();
         LogInfo("[=] Display angle:%d width:%d height:%d", displayInfo.theta, displayInfo.width, displayInfo.height);
+        if (m_options.autoUpdateOrientation && !m_displayWatcherStarted)
+        {
+            ANativeWindowCreator::StartDisplayWatcher();
+            m_displayWatcherStarted = true;
+        }
+        ANativeWindowCreator::SetVirtualDisplayTracking(m_options.trackVirtualDisplays);
+        RecordStartupPhase("Display info", phaseStart);
 
         if (RenderType::RenderClient != m_options.renderType)
         {
             // Create native window
-            m_nativeWindow = ANativeWindowCreator::Create({.name = "AImGui", .skipScreenshot = false});
+            phaseStart = std::chrono::steady_clock::now();
+            m_nativeWindow = ANativeWindowCreator::Create({.name = "AImGui", .skipScreenshot = false, .pixelFormat = surfaceFormat.pixelFormat});
             if (nullptr == m_nativeWindow)
             {
                 LogDebug("[-] ANativeWindow create failed");
@@ -694,52 +1059,80 @@ namespace android
             LogInfo("[=] Acquiring native window");
             ANativeWindow_acquire(m_nativeWindow);
             LogInfo("[+] Native window acquired");
+            RecordStartupPhase("Native window", phaseStart);
         }
 
-        // EGL initialization
-        m_defaultDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-        if (EGL_NO_DISPLAY == m_defaultDisplay)
+        // A client only builds draw data, it never touches EGL or GLES
+        if (RenderType::RenderClient != m_options.renderType)
         {
-            LogDebug("[-] EGL get default display failed: %d", eglGetError());
-            return false;
-        }
+            if (!eglDisplayTask.get())
+                return false;
 
-        if (EGL_TRUE != eglInitialize(m_defaultDisplay, 0, 0))
-        {
-            LogDebug("[-] EGL initialize failed: %d", eglGetError());
-            return false;
-        }
+            phaseStart = std::chrono::steady_clock::now();
+            // EGL sorts deeper color buffers first, pick the config matching the format exactly
+            const auto chooseEglConfig = [this](const SurfaceFormatInfo &format, EGLConfig *config, bool *exactMatch)
+            {
+                EGLint numEglConfig = 0;
+                EGLConfig eglConfigs[64]{};
+                std::pair<EGLint, EGLint> eglConfigAttributeList[] = {
+                    {EGL_SURFACE_TYPE, EGL_WINDOW_BIT},                 // 渲染表面类型为窗口
+                    {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR},      // 使用OpenGL ES 3.0
+                    {EGL_RED_SIZE, format.redSize},                     // 红色分量位数
+                    {EGL_GREEN_SIZE, format.greenSize},                 // 绿色分量位数
+                    {EGL_BLUE_SIZE, format.blueSize},                   // 蓝色分量位数
+                    {EGL_ALPHA_SIZE, format.alphaSize},                 // Alpha 位数
+                    {EGL_DEPTH_SIZE, 0},                                // ImGui 不使用深度缓冲
+                    {EGL_STENCIL_SIZE, 0},                              // ImGui 不使用模板缓冲
+                    {EGL_SAMPLE_BUFFERS, 0},                            // 多重采样抗锯齿缓冲禁用
+                    {EGL_NONE, EGL_NONE},
+                };
+                if (EGL_TRUE != eglChooseConfig(m_defaultDisplay, reinterpret_cast<const EGLint *>(eglConfigAttributeList), eglConfigs, std::size(eglConfigs), &numEglConfig))
+                {
+                    LogDebug("[-] EGL choose config failed: %d", eglGetError());
+                    return false;
+                }
+                if (0 == numEglConfig)
+                {
+                    LogDebug("[-] EGL choose config failed: No OpenGL ES 3 config supports the attribute list.");
+                    return false;
+                }
 
-        EGLint numEglConfig = 0;
-        EGLConfig eglConfig{};
-        std::pair<EGLint, EGLint> eglConfigAttributeList[] = {
-            {
-                EGL_SURFACE_TYPE,
-                RenderType::RenderClient != m_options.renderType ? EGL_WINDOW_BIT : EGL_PBUFFER_BIT,
-            },                                         // 根据服务类型选择渲染表面类型为窗口或像素缓冲区
-            {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT}, // 使用OpenGL ES 2.0
-            {EGL_RED_SIZE, 8},                         // 红色分量位数为8位
-            {EGL_GREEN_SIZE, 8},                       // 绿色分量位数为8位
-            {EGL_BLUE_SIZE, 8},                        // 蓝色分量位数为8位
-            {EGL_ALPHA_SIZE, 8},                       // Alpha 位数为8位
-            {EGL_DEPTH_SIZE, 24},                      // 深度缓冲位数为24位
-            {EGL_STENCIL_SIZE, 8},                     // 模板缓冲位数为8位
-            {EGL_SAMPLE_BUFFERS, 0},                   // 多重采样抗锯齿缓冲禁用
-            {EGL_NONE, EGL_NONE},
-        };
-        if (EGL_TRUE != eglChooseConfig(m_defaultDisplay, reinterpret_cast<const EGLint *>(eglConfigAttributeList), &eglConfig, 1, &numEglConfig))
-        {
-            LogDebug("[-] EGL choose config failed: %d", eglGetError());
-            return false;
-        }
-        if (0 == numEglConfig)
-        {
-            LogDebug("[-] EGL choose config failed: Unsupported config attribute list.");
-            return false;
-        }
+                *config = eglConfigs[0];
+                *exactMatch = false;
+                for (EGLint i = 0; i < numEglConfig; ++i)
+                {
+                    EGLint redSize = 0, greenSize = 0, blueSize = 0, alphaSize = 0, depthSize = 0, stencilSize = 0;
+
+                    eglGetConfigAttrib(m_defaultDisplay, eglConfigs[i], EGL_RED_SIZE, &redSize);
+                    eglGetConfigAttrib(m_defaultDisplay, eglConfigs[i], EGL_GREEN_SIZE, &greenSize);
+                    eglGetConfigAttrib(m_defaultDisplay, eglConfigs[i], EGL_BLUE_SIZE, &blueSize);
+                    eglGetConfigAttrib(m_defaultDisplay, eglConfigs[i], EGL_ALPHA_SIZE, &alphaSize);
+                    eglGetConfigAttrib(m_defaultDisplay, eglConfigs[i], EGL_DEPTH_SIZE, &depthSize);
+                    eglGetConfigAttrib(m_defaultDisplay, eglConfigs[i], EGL_STENCIL_SIZE, &stencilSize);
+                    if (format.redSize == redSize && format.greenSize == greenSize && format.blueSize == blueSize && format.alphaSize == alphaSize && 0 == depthSize && 0 == stencilSize)
+                    {
+                        *config = eglConfigs[i];
+                        *exactMatch = true;
+                        break;
+                    }
+                }
+
+                return true;
+            };
+
+            EGLConfig eglConfig{};
+            bool eglConfigExactMatch = false;
+            auto chosenFormat = &surfaceFormat;
+            if (!chooseEglConfig(surfaceFormat, &eglConfig, &eglConfigExactMatch))
+                return false;
+            if (!eglConfigExactMatch && &surfaceFormats[0] != &surfaceFormat)
+            {
+                LogInfo("[-] No EGL config matches surface format %s, falling back to %s", surfaceFormat.name, surfaceFormats[0].name);
+                chosenFormat = &surfaceFormats[0];
+                if (!chooseEglConfig(*chosenFormat, &eglConfig, &eglConfigExactMatch))
+                    return false;
+            }
 
-        if (RenderType::RenderClient != m_options.renderType)
-        {
             EGLint eglBufferFormat;
             if (EGL_TRUE != eglGetConfigAttrib(m_defaultDisplay, eglConfig, EGL_NATIVE_VISUAL_ID, &eglBufferFormat))
             {
@@ -747,66 +1140,92 @@ namespace android
                 return false;
             }
             ANativeWindow_setBuffersGeometry(m_nativeWindow, 0, 0, eglBufferFormat);
+            if (1.f != m_options.renderScale)
+            {
+                ANativeWindowCreator::Resize(m_nativeWindow, static_cast<int32_t>(displayInfo.width * m_options.renderScale), static_cast<int32_t>(displayInfo.height * m_options.renderScale));
+                ANativeWindowCreator::SetScale(m_nativeWindow, 1.f / m_options.renderScale, 1.f / m_options.renderScale);
+                LogInfo("[=] Render scale:%.2f", m_options.renderScale);
+            }
+
+            // Report what EGL actually chose, the requested format is only a lower bound
+            EGLint redSize = 0, greenSize = 0, blueSize = 0, alphaSize = 0;
+            eglGetConfigAttrib(m_defaultDisplay, eglConfig, EGL_RED_SIZE, &redSize);
+            eglGetConfigAttrib(m_defaultDisplay, eglConfig, EGL_GREEN_SIZE, &greenSize);
+            eglGetConfigAttrib(m_defaultDisplay, eglConfig, EGL_BLUE_SIZE, &blueSize);
+            eglGetConfigAttrib(m_defaultDisplay, eglConfig, EGL_ALPHA_SIZE, &alphaSize);
+
+            auto bytesPerPixel = (redSize + greenSize + blueSize + alphaSize + 7) / 8;
+            auto bufferWidth = static_cast<int32_t>(displayInfo.width * m_options.renderScale);
+            auto bufferHeight = static_cast<int32_t>(displayInfo.height * m_options.renderScale);
+            LogInfo("[=] Surface format:%s config:R%dG%dB%dA%d native format:%d buffer:%dx%d %.2fMB per buffer",
+                    chosenFormat->name,
+                    redSize,
+                    greenSize,
+                    blueSize,
+                    alphaSize,
+                    eglBufferFormat,
+                    bufferWidth,
+                    bufferHeight,
+                    bufferWidth * bufferHeight * bytesPerPixel / 1024.f / 1024.f);
             m_eglSurface = eglCreateWindowSurface(m_defaultDisplay, eglConfig, m_nativeWindow, nullptr);
-        }
-        else
-        {
-            std::pair<EGLint, EGLint> bufferAttribute[] = {
-                {EGL_WIDTH, displayInfo.width},
-                {EGL_HEIGHT, displayInfo.height},
-                {EGL_NONE, EGL_NONE},
-            };
+            if (EGL_NO_SURFACE == m_eglSurface)
+            {
+                LogDebug("[-] EGL create window surface failed: %d", eglGetError());
+                return false;
+            }
 
-            m_eglSurface = eglCreatePbufferSurface(m_defaultDisplay, eglConfig, reinterpret_cast<const EGLint *>(bufferAttribute));
-        }
-        if (EGL_NO_SURFACE == m_eglSurface)
-        {
-            LogDebug("[-] EGL create window surface failed: %d", eglGetError());
-            return false;
-        }
+            if (m_options.partialRedraw)
+            {
+                auto eglExtensions = eglQueryString(m_defaultDisplay, EGL_EXTENSIONS);
+
+                m_eglBufferAgeSupported = HasEglExtension(eglExtensions, "EGL_EXT_buffer_age") || HasEglExtension(eglExtensions, "EGL_KHR_partial_update");
+                if (HasEglExtension(eglExtensions, "EGL_KHR_partial_update"))
+                    m_eglSetDamageRegion = reinterpret_cast<PFNEGLSETDAMAGEREGIONKHRPROC>(eglGetProcAddress("eglSetDamageRegionKHR"));
+                if (HasEglExtension(eglExtensions, "EGL_KHR_swap_buffers_with_damage"))
+                    m_eglSwapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+                else if (HasEglExtension(eglExtensions, "EGL_EXT_swap_buffers_with_damage"))
+                    m_eglSwapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+                m_damageTracker.Invalidate();
+
+                LogInfo("[=] Partial redraw buffer age:%d set damage:%d swap with damage:%d", m_eglBufferAgeSupported, nullptr != m_eglSetDamageRegion, nullptr != m_eglSwapBuffersWithDamage);
+            }
 
-        EGLint eglContextAttribList[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
-        m_eglContext = eglCreateContext(m_defaultDisplay, eglConfig, EGL_NO_CONTEXT, eglContextAttribList);
-        if (EGL_NO_CONTEXT == m_eglContext)
-        {
-            LogDebug("[-] EGL create context failed: %d", eglGetError());
-            return false;
-        }
+            // The renderer relies on mapped buffers, vertex array objects and fence syncs, all of them OpenGL ES 3
+            EGLint eglContextAttribList[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+            m_eglContext = eglCreateContext(m_defaultDisplay, eglConfig, EGL_NO_CONTEXT, eglContextAttribList);
+            if (EGL_NO_CONTEXT == m_eglContext)
+            {
+                LogDebug("[-] EGL create OpenGL ES 3 context failed: %d", eglGetError());
+                return false;
+            }
 
-        if (EGL_TRUE != eglMakeCurrent(m_defaultDisplay, m_eglSurface, m_eglSurface, m_eglContext))
-        {
-            LogDebug("[-] EGL make current failed: %d", eglGetError());
-            return false;
+            if (EGL_TRUE != eglMakeCurrent(m_defaultDisplay, m_eglSurface, m_eglSurface, m_eglContext))
+            {
+                LogDebug("[-] EGL make current failed: %d", eglGetError());
+                return false;
+            }
+            RecordStartupPhase("EGL surface and context", phaseStart);
         }
 
-        // ImGui initialization
-        IMGUI_CHECKVERSION();
-
-        m_imguiContext = ImGui::CreateContext();
-        if (nullptr == m_imguiContext)
+        fontTask.wait();
+        if (RenderType::RenderClient == m_options.renderType)
         {
-            LogDebug("[-] ImGui create context failed");
-            return false;
-        }
-
-        auto &imguiIO = ImGui::GetIO();
-
-        imguiIO.IniFilename = nullptr;
-        ImGui::StyleColorsDark();
-        ImGui::GetStyle().ScaleAllSizes(3.f);
+            if (!connectTask.get())
+                return false;
 
-        ImFontConfig fontConfig;
-        fontConfig.SizePixels = 22.f;
-        imguiIO.Fonts->AddFontDefault(&fontConfig);
-        if (RenderType::RenderClient == m_options.renderType && m_options.exchangeFontData)
-        {
-            auto sharedFontData = ImGui::GetSharedFontData();
-            uint32_t packetSize = static_cast<uint32_t>(sharedFontData.size());
-            // First packet
-            WriteData(&packetSize, sizeof(packetSize));
-            WriteData(sharedFontData.data(), sharedFontData.size());
+            if (m_options.exchangeFontData)
+            {
+                phaseStart = std::chrono::steady_clock::now();
+                auto sharedFontData = ImGui::GetSharedFontData();
+                uint32_t packetSize = static_cast<uint32_t>(sharedFontData.size());
+                // First packet
+                WriteData(&packetSize, sizeof(packetSize));
+                WriteData(sharedFontData.data(), sharedFontData.size());
+                RecordStartupPhase("Font send", phaseStart);
+            }
         }
 
+        phaseStart = std::chrono::steady_clock::now();
         if (RenderType::RenderClient != m_options.renderType)
         {
             if (!ImGui_ImplAndroid_Init(m_nativeWindow))
@@ -819,31 +1238,101 @@ namespace android
         {
             imguiIO.BackendPlatformName = "imgui_impl_aimgui";
         }
-        if (!ImGui_ImplOpenGL3_Init("#version 300 es"))
+        if (RenderType::RenderClient != m_options.renderType)
         {
-            LogDebug("[-] ImGui init OpenGL3 failed");
-            return false;
-        }
+            if (!m_renderer.Init(m_options.programCacheDirectory))
+            {
+                LogDebug("[-] ImGui init GLES3 renderer failed");
+                return false;
+            }
+            m_frameProfiler.InitGpuTimer();
+            if (HasEglExtension(eglQueryString(m_defaultDisplay, EGL_EXTENSIONS), "EGL_ANDROID_get_frame_timestamps"))
+                m_frameProfiler.InitPresentTimer(m_defaultDisplay, m_eglSurface);
 
-        glViewport(0, 0, displayInfo.width, displayInfo.height);
-        glClearColor(0.f, 0.f, 0.f, 0.f);
+            glViewport(0, 0, static_cast<GLsizei>(displayInfo.width * m_options.renderScale), static_cast<GLsizei>(displayInfo.height * m_options.renderScale));
+            glClearColor(0.f, 0.f, 0.f, 0.f);
+        }
+        RecordStartupPhase("Backends", phaseStart);
 
         m_rotateTheta = displayInfo.theta;
         m_screenWidth = displayInfo.width;
         m_screenHeight = displayInfo.height;
 
+        if (RenderType::RenderClient != m_options.renderType)
+        {
+            if (m_options.inputReplayPath.empty())
+                m_touchEvent = std::make_unique<ATouchEvent>();
+            else
+                m_touchEvent = std::make_unique<ATouchEvent>(m_options.inputReplayPath, m_options.inputReplaySpeed);
+            if (!m_options.inputRecordPath.empty())
+                m_touchEvent->StartRecording(m_options.inputRecordPath);
+        }
+        else
+            m_inputWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (RenderType::RenderNative == m_options.renderType && m_options.threadedRendering)
+        {
+            // The render thread takes the EGL context over, the renderer created all of its GL objects in Init
+            eglMakeCurrent(m_defaultDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+            m_renderThreadRunning = true;
+            m_renderThread = std::make_unique<std::thread>(&AImGui::RenderWorker, this);
+            LogInfo("[+] Render thread started");
+        }
+
+        {
+            std::lock_guard lock(m_startupMutex);
+
+            m_startupMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_startupStart).count();
+            for (const auto &phase : m_startupPhases)
+                LogInfo("[=] Startup %-24s at %8.2fms took %8.2fms", phase.name, phase.startMilliseconds, phase.durationMilliseconds);
+            LogInfo("[+] Startup finished in %.2fms", m_startupMilliseconds);
+        }
+
         return (m_state = true);
     }
     void AImGui::UnInitEnvironment()
     {
         m_state = false;
 
-        if (nullptr != m_imguiContext)
+        if (m_renderThread)
         {
-            ImGui_ImplOpenGL3_Shutdown();
+            {
+                std::lock_guard lock(m_frameMutex);
 
+                m_renderThreadRunning = false;
+            }
+            m_frameCondition.notify_all();
+
+            if (m_renderThread->joinable())
+                m_renderThread->join();
+            m_renderThread.reset();
+
+            eglMakeCurrent(m_defaultDisplay, m_eglSurface, m_eglSurface, m_eglContext);
+        }
+        for (auto &frame : m_frames)
+        {
+            for (auto drawList : frame.drawLists)
+                IM_DELETE(drawList);
+            frame.drawLists.clear();
+            frame.drawData.Clear();
+        }
+
+        if (m_displayWatcherStarted)
+        {
+            ANativeWindowCreator::StopDisplayWatcher();
+            m_displayWatcherStarted = false;
+        }
+
+        if (nullptr != m_imguiContext)
+        {
             if (RenderType::RenderClient != m_options.renderType)
+            {
+                m_frameProfiler.ShutdownGpuTimer();
+                m_frameProfiler.ShutdownPresentTimer();
+                m_renderer.Shutdown();
                 ImGui_ImplAndroid_Shutdown();
+            }
             else
                 ImGui::GetIO().BackendPlatformName = nullptr;
             ImGui::DestroyContext(m_imguiContext);
@@ -873,11 +1362,416 @@ namespace android
         close(m_clientFd);
         close(m_serverFd);
 
+        m_touchEvent.reset();
+        if (-1 != m_inputWakeFd)
+        {
+            close(m_inputWakeFd);
+            m_inputWakeFd = -1;
+        }
+
         m_imguiContext = nullptr;
         m_eglContext = EGL_NO_CONTEXT;
         m_eglSurface = EGL_NO_SURFACE;
         m_defaultDisplay = EGL_NO_DISPLAY;
         m_nativeWindow = nullptr;
+        m_eglBufferAgeSupported = false;
+        m_eglSetDamageRegion = nullptr;
+        m_eglSwapBuffersWithDamage = nullptr;
+    }
+
+    void AImGui::ResizeEnvironment(int theta, int width, int height)
+    {
+        LogInfo("[=] Display orientation changed angle:%d width:%d height:%d", theta, width, height);
+
+        // Only the surface follows the new orientation, the EGL window surface picks up
+        // the new buffer size on its next dequeue and everything else stays alive.
+        // With a render thread the surface follows the screen size of the next submitted frame.
+        if (RenderType::RenderClient != m_options.renderType && !m_renderThread)
+        {
+            if (m_options.autoFit)
+            {
+                // The surface is refitted to the new screen on the next presented frame
+                m_fitRect = {};
+                m_fitShrinkFrames = 0;
+            }
+            else
+                ResizeSurface(width, height);
+        }
+
+        m_rotateTheta = theta;
+        m_screenWidth = width;
+        m_screenHeight = height;
+    }
+
+    void AImGui::ResizeSurface(int width, int height)
+    {
+        // The buffer is scaled down by renderScale, the layer matrix set at initialization scales it back up
+        auto bufferWidth = static_cast<int32_t>(width * m_options.renderScale);
+        auto bufferHeight = static_cast<int32_t>(height * m_options.renderScale);
+
+        ANativeWindowCreator::Resize(m_nativeWindow, bufferWidth, bufferHeight);
+        glViewport(0, 0, bufferWidth, bufferHeight);
+    }
+
+    void AImGui::FitSurfaceToDrawData(ImDrawData *drawData, int screenWidth, int screenHeight)
+    {
+        constexpr int32_t padding = 8;
+        constexpr int32_t alignment = 16;
+        constexpr int shrinkDelayFrames = 60;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (const auto &cmdList : drawData->CmdLists)
+        {
+            for (const auto &vertex : cmdList->VtxBuffer)
+            {
+                minX = std::min(minX, vertex.pos.x);
+                minY = std::min(minY, vertex.pos.y);
+                maxX = std::max(maxX, vertex.pos.x);
+                maxY = std::max(maxY, vertex.pos.y);
+            }
+        }
+
+        ADamageTracker::Rect screenRect{0, 0, screenWidth, screenHeight};
+        ADamageTracker::Rect targetRect{};
+        if (minX <= maxX && minY <= maxY)
+        {
+            targetRect = ADamageTracker::Rect{
+                (static_cast<int32_t>(std::floor(minX)) - padding) & ~(alignment - 1),
+                (static_cast<int32_t>(std::floor(minY)) - padding) & ~(alignment - 1),
+                (static_cast<int32_t>(std::ceil(maxX)) + padding + alignment - 1) & ~(alignment - 1),
+                (static_cast<int32_t>(std::ceil(maxY)) + padding + alignment - 1) & ~(alignment - 1),
+            }.Intersect(screenRect);
+        }
+
+        ADamageTracker::Rect fitRect = m_fitRect;
+        if (!targetRect.IsEmpty())
+        {
+            // Grow right away so nothing gets cut, shrink only once the ui stayed smaller for a while
+            if (!fitRect.Contains(targetRect))
+            {
+                fitRect = fitRect.Union(targetRect).Intersect(screenRect);
+                m_fitShrinkFrames = 0;
+            }
+            else if (!targetRect.Contains(fitRect) && shrinkDelayFrames <= ++m_fitShrinkFrames)
+            {
+                fitRect = targetRect;
+                m_fitShrinkFrames = 0;
+            }
+        }
+        if (fitRect.IsEmpty())
+            return;
+
+        if (!fitRect.Contains(m_fitRect) || !m_fitRect.Contains(fitRect))
+        {
+            auto width = fitRect.right - fitRect.left, height = fitRect.bottom - fitRect.top;
+
+            LogDebug("[=] Fit surface to x:%d y:%d width:%d height:%d", fitRect.left, fitRect.top, width, height);
+
+            // Size and position must land together with the buffer of this frame
+            ResizeSurface(width, height);
+            ANativeWindowCreator::SetPosition(m_nativeWindow, static_cast<float>(fitRect.left), static_cast<float>(fitRect.top));
+            ANativeWindowCreator::FlushTransactionBatch();
+
+            m_fitRect = fitRect;
+            m_damageTracker.Invalidate();
+        }
+
+        // Ui coordinates stay in screen space, only the projection is offset to the surface
+        drawData->DisplayPos = {static_cast<float>(m_fitRect.left), static_cast<float>(m_fitRect.top)};
+        drawData->DisplaySize = {static_cast<float>(m_fitRect.right - m_fitRect.left), static_cast<float>(m_fitRect.bottom - m_fitRect.top)};
+    }
+
+    void AImGui::PresentDrawData(ImDrawData *drawData, int screenWidth, int screenHeight)
+    {
+        AIMGUI_TRACE_SCOPE("AImGui::PresentDrawData");
+        drawData->FramebufferScale = {m_options.renderScale, m_options.renderScale};
+        if (m_options.autoHideSurface)
+        {
+            // SurfaceFlinger skips hidden layers, so a dormant overlay costs neither composition nor swaps
+            if (0 == drawData->TotalVtxCount)
+            {
+                if (!m_surfaceHidden)
+                {
+                    ANativeWindowCreator::Hide(m_nativeWindow);
+                    m_surfaceHidden = true;
+                }
+
+                // Nothing reaches the screen, the input would be measured at some later frame
+                m_frameProfiler.TakeInput();
+                PaceSkippedFrame();
+                return;
+            }
+            if (m_surfaceHidden)
+            {
+                // Show lands with the batch after this frame's buffer is queued, the stale one is never seen
+                ANativeWindowCreator::Show(m_nativeWindow);
+                m_damageTracker.Invalidate();
+                m_surfaceHidden = false;
+            }
+        }
+        if (m_options.autoFit)
+            FitSurfaceToDrawData(drawData, screenWidth, screenHeight);
+
+        if (!m_options.partialRedraw)
+        {
+            auto phaseStart = std::chrono::steady_clock::now();
+            m_frameProfiler.BeginGpuTimer();
+            glClear(GL_COLOR_BUFFER_BIT);
+            m_renderer.RenderDrawData(drawData);
+            m_frameProfiler.EndGpuTimer();
+            m_frameProfiler.Record(AFrameProfiler::Phase::Submit, phaseStart);
+            RecordPresentCounters(drawData);
+
+            phaseStart = std::chrono::steady_clock::now();
+            m_frameProfiler.BeginPresent();
+            eglSwapBuffers(m_defaultDisplay, m_eglSurface);
+            m_frameProfiler.Record(AFrameProfiler::Phase::Swap, phaseStart);
+            m_frameProfiler.MarkPresent();
+            MarkFrameSwapped();
+            return;
+        }
+
+        EGLint bufferAge = 0;
+        if (m_eglBufferAgeSupported && EGL_TRUE != eglQuerySurface(m_defaultDisplay, m_eglSurface, EGL_BUFFER_AGE_EXT, &bufferAge))
+            bufferAge = 0;
+
+        auto repaintRect = m_damageTracker.Update(drawData, bufferAge);
+        if (repaintRect.IsEmpty())
+        {
+            // Nothing changed since the last presented frame, keep it on screen and drop its input.
+            // Without a swap to block on, the loop waits out the frame itself.
+            m_frameProfiler.TakeInput();
+            PaceSkippedFrame();
+            return;
+        }
+
+        // EGL damage rectangles have their origin at the bottom left corner
+        auto framebufferHeight = static_cast<EGLint>(drawData->DisplaySize.y * drawData->FramebufferScale.y);
+        EGLint damageRect[] = {
+            repaintRect.left,
+            framebufferHeight - repaintRect.bottom,
+            repaintRect.right - repaintRect.left,
+            repaintRect.bottom - repaintRect.top,
+        };
+        if (nullptr != m_eglSetDamageRegion)
+            m_eglSetDamageRegion(m_defaultDisplay, m_eglSurface, damageRect, 1);
+
+        auto phaseStart = std::chrono::steady_clock::now();
+        m_frameProfiler.BeginGpuTimer();
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(damageRect[0], damageRect[1], damageRect[2], damageRect[3]);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
+
+        ADamageTracker::ClipDrawData(drawData, repaintRect);
+        m_renderer.RenderDrawData(drawData);
+        m_frameProfiler.EndGpuTimer();
+        m_frameProfiler.Record(AFrameProfiler::Phase::Submit, phaseStart);
+        RecordPresentCounters(drawData);
+
+        phaseStart = std::chrono::steady_clock::now();
+        m_frameProfiler.BeginPresent();
+        if (nullptr != m_eglSwapBuffersWithDamage)
+            m_eglSwapBuffersWithDamage(m_defaultDisplay, m_eglSurface, damageRect, 1);
+        else
+            eglSwapBuffers(m_defaultDisplay, m_eglSurface);
+        m_frameProfiler.Record(AFrameProfiler::Phase::Swap, phaseStart);
+        m_frameProfiler.MarkPresent();
+        MarkFrameSwapped();
+    }
+
+    void AImGui::MarkFrameSwapped()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto interval = now - m_lastFrameSwap;
+
+        // Swaps block on the display refresh, back to back ones measure it. Longer gaps are idle time.
+        if (std::chrono::milliseconds(4) < interval && std::chrono::milliseconds(50) > interval)
+            m_frameSwapInterval = (m_frameSwapInterval * 7 + std::chrono::duration_cast<std::chrono::nanoseconds>(interval)) / 8;
+        m_lastFrameSwap = now;
+    }
+
+    void AImGui::PaceSkippedFrame()
+    {
+        auto nextFrame = m_lastFrameSwap + m_frameSwapInterval;
+        auto now = std::chrono::steady_clock::now();
+        if (nextFrame > now)
+            std::this_thread::sleep_until(nextFrame);
+        else
+            nextFrame = now;
+
+        // Skipped frames chain on each other so that the loop keeps the display rate
+        m_lastFrameSwap = nextFrame;
+    }
+
+    void AImGui::RecordPresentCounters(const ImDrawData *drawData)
+    {
+        m_frameProfiler.Record(AFrameProfiler::Counter::DrawCalls, static_cast<float>(m_renderer.GetDrawCallCount()));
+
+        // A server already counted the received packet
+        if (RenderType::RenderNative == m_options.renderType)
+            m_frameProfiler.Record(AFrameProfiler::Counter::FrameBytes, static_cast<float>(drawData->TotalVtxCount * sizeof(ImDrawVert) + drawData->TotalIdxCount * sizeof(uint32_t)));
+    }
+
+    void AImGui::SubmitDrawData(const ImDrawData *drawData)
+    {
+        auto &frame = m_frames[m_writeFrame];
+
+        // Take the vertex, index and command buffers over instead of copying them, ImGui
+        // resets its draw lists at the next NewFrame and keeps reusing the returned ones.
+        frame.drawData.Clear();
+        for (int i = 0; i < drawData->CmdListsCount; ++i)
+        {
+            if (frame.drawLists.Size <= i)
+                frame.drawLists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+
+            auto sourceList = drawData->CmdLists[i];
+            auto frameList = frame.drawLists[i];
+
+            frameList->CmdBuffer.swap(sourceList->CmdBuffer);
+            frameList->IdxBuffer.swap(sourceList->IdxBuffer);
+            frameList->VtxBuffer.swap(sourceList->VtxBuffer);
+            frameList->Flags = sourceList->Flags;
+            frame.drawData.AddDrawList(frameList);
+        }
+        frame.drawData.Valid = true;
+        frame.drawData.DisplayPos = drawData->DisplayPos;
+        frame.drawData.DisplaySize = drawData->DisplaySize;
+        frame.drawData.FramebufferScale = drawData->FramebufferScale;
+        frame.screenWidth = m_screenWidth;
+        frame.screenHeight = m_screenHeight;
+
+        {
+            std::lock_guard lock(m_frameMutex);
+
+            // The render thread never picked the previous frame up, it is replaced unseen
+            if (m_frameReady)
+                m_frameProfiler.AddDroppedFrame();
+            std::swap(m_writeFrame, m_readyFrame);
+            m_frameReady = true;
+        }
+        m_frameCondition.notify_one();
+    }
+
+    void AImGui::RenderWorker()
+    {
+        if (EGL_TRUE != eglMakeCurrent(m_defaultDisplay, m_eglSurface, m_eglSurface, m_eglContext))
+        {
+            LogDebug("[-] Render thread make current failed: %d", eglGetError());
+            m_state = false;
+            return;
+        }
+
+        int screenWidth = m_screenWidth, screenHeight = m_screenHeight;
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_frameMutex);
+
+                m_frameCondition.wait(lock, [this]
+                                      { return m_frameReady || !m_renderThreadRunning; });
+                if (!m_renderThreadRunning)
+                    break;
+
+                std::swap(m_renderFrame, m_readyFrame);
+                m_frameReady = false;
+            }
+
+            auto &frame = m_frames[m_renderFrame];
+            if (frame.screenWidth != screenWidth || frame.screenHeight != screenHeight)
+            {
+                screenWidth = frame.screenWidth;
+                screenHeight = frame.screenHeight;
+                if (m_options.autoFit)
+                {
+                    m_fitRect = {};
+                    m_fitShrinkFrames = 0;
+                }
+                else
+                    ResizeSurface(screenWidth, screenHeight);
+            }
+
+            // Geometry changes of this thread go out together after the frame is queued
+            ANativeWindowCreator::BeginTransactionBatch();
+            PresentDrawData(&frame.drawData, screenWidth, screenHeight);
+            ANativeWindowCreator::ApplyTransactionBatch();
+        }
+
+        eglMakeCurrent(m_defaultDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    void AImGui::DrawPerformanceOverlay()
+    {
+        std::array<float, AFrameProfiler::SampleCount> samples{};
+
+        ImGui::SetNextWindowPos({16.f, 16.f}, ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowBgAlpha(0.75f);
+        if (!ImGui::Begin("AImGui Performance", &m_performanceOverlayVisible, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing))
+        {
+            ImGui::End();
+            return;
+        }
+
+        auto frameTime = m_frameProfiler.GetStatistics(AFrameProfiler::Counter::FrameTime);
+        ImGui::Text("Frame %.2fms (%.1f fps)  p95 %.2fms  p99 %.2fms", frameTime.average, 0.f < frameTime.average ? 1000.f / frameTime.average : 0.f, frameTime.p95, frameTime.p99);
+        auto sampleCount = m_frameProfiler.ReadSamples(AFrameProfiler::Counter::FrameTime, samples.data(), samples.size());
+        ImGui::PlotLines("##FrameTime", samples.data(), static_cast<int>(sampleCount), 0, nullptr, 0.f, std::max(frameTime.p99 * 1.25f, 1.f), {0.f, 80.f});
+
+        if (ImGui::BeginTable("##Phases", 5))
+        {
+            ImGui::TableSetupColumn("Phase");
+            ImGui::TableSetupColumn("Last");
+            ImGui::TableSetupColumn("p50");
+            ImGui::TableSetupColumn("p95");
+            ImGui::TableSetupColumn("p99");
+            ImGui::TableHeadersRow();
+            for (size_t i = 0; i < AFrameProfiler::PhaseCount; ++i)
+            {
+                auto phase = static_cast<AFrameProfiler::Phase>(i);
+                auto statistics = m_frameProfiler.GetStatistics(phase);
+                if (0 == statistics.sampleCount)
+                    continue; // Phases of the other render types
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(AFrameProfiler::GetPhaseName(phase));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", statistics.last);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", statistics.p50);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", statistics.p95);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", statistics.p99);
+            }
+            ImGui::EndTable();
+        }
+
+        auto frameBytes = m_frameProfiler.GetStatistics(AFrameProfiler::Counter::FrameBytes);
+        auto compressionRatio = m_frameProfiler.GetStatistics(AFrameProfiler::Counter::CompressionRatio);
+        auto drawCalls = m_frameProfiler.GetStatistics(AFrameProfiler::Counter::DrawCalls);
+        auto inputLatency = m_frameProfiler.GetStatistics(AFrameProfiler::Counter::InputLatency);
+        ImGui::Separator();
+        ImGui::Text("Bytes per frame %.1fKB  max %.1fKB", frameBytes.average / 1024.f, frameBytes.p99 / 1024.f);
+        if (0 != compressionRatio.sampleCount)
+            ImGui::Text("Compression ratio %.2f", compressionRatio.average);
+        if (0 != drawCalls.sampleCount)
+            ImGui::Text("Draw calls %.0f  p95 %.0f", drawCalls.last, drawCalls.p95);
+        ImGui::Text("Input latency p50 %.2fms  p95 %.2fms  p99 %.2fms", inputLatency.p50, inputLatency.p95, inputLatency.p99);
+        auto latencyHistogram = m_frameProfiler.GetInputLatencyHistogram();
+        if (0 != latencyHistogram.totalCount)
+        {
+            std::array<float, AFrameProfiler::LatencyHistogram::BucketCount> bucketCounts{};
+            for (size_t i = 0; i < bucketCounts.size(); ++i)
+                bucketCounts[i] = static_cast<float>(latencyHistogram.counts[i]);
+
+            char histogramLabel[64];
+            snprintf(histogramLabel, sizeof(histogramLabel), "0-%.0fms, %.0fms per bar", AFrameProfiler::LatencyHistogram::BucketCount * AFrameProfiler::LatencyHistogram::BucketMilliseconds, AFrameProfiler::LatencyHistogram::BucketMilliseconds);
+            ImGui::PlotHistogram("##InputLatency", bucketCounts.data(), static_cast<int>(bucketCounts.size()), 0, histogramLabel, 0.f, FLT_MAX, {0.f, 60.f});
+        }
+        ImGui::Text("Dropped frames %llu", static_cast<unsigned long long>(m_frameProfiler.GetDroppedFrames()));
+
+        ImGui::End();
     }
 
     void AImGui::ServerWorker()
@@ -891,6 +1785,7 @@ namespace android
         }
 
         uint32_t packetSize = 0;
+        int64_t inputNanoseconds = 0, pendingInputNanoseconds = 0;
         while (m_state)
         {
             if (static_cast<int>(sizeof(packetSize)) > ReadData(&packetSize, sizeof(packetSize)))
@@ -898,24 +1793,40 @@ namespace android
                 LogDebug("[-] Server can not read packet size, %d:%s", errno, strerror(errno));
                 break;
             }
+            // Frame packets carry the timestamp of the oldest input the client consumed for them
+            auto fontPacket = m_options.exchangeFontData && m_serverFontData.empty();
+            if (!fontPacket && static_cast<int>(sizeof(inputNanoseconds)) > ReadData(&inputNanoseconds, sizeof(inputNanoseconds)))
+            {
+                LogDebug("[-] Server can not read packet input time, %d:%s", errno, strerror(errno));
+                break;
+            }
+            if (!fontPacket && 0 != inputNanoseconds && (0 == pendingInputNanoseconds || inputNanoseconds < pendingInputNanoseconds))
+                pendingInputNanoseconds = inputNanoseconds;
             if (packetSize > m_maxPacketSize)
             {
                 LogDebug("[-] Packet is too large: %2.f", packetSize / 1024.f / 1024.f);
                 break;
             }
 
+            AIMGUI_TRACE_SCOPE("AImGui::ServerWorker::Packet");
             if (m_serverRenderDataBack.size() < packetSize)
                 m_serverRenderDataBack.resize(packetSize);
+            auto phaseStart = std::chrono::steady_clock::now();
             auto readResult = ReadData(m_serverRenderDataBack.data(), packetSize);
+            m_frameProfiler.Record(AFrameProfiler::Phase::Receive, phaseStart);
             if (0 >= readResult)
             {
                 LogDebug("[-] Client disconnect or read failed, readResult:%d  %d:%s", readResult, errno, strerror(errno));
                 break;
             }
 
+            m_frameProfiler.Record(AFrameProfiler::Counter::FrameBytes, static_cast<float>(sizeof(packetSize) + (fontPacket ? 0 : sizeof(inputNanoseconds)) + packetSize));
             if (RenderState::ReadData != m_renderState)
+            {
+                m_frameProfiler.AddDroppedFrame();
                 continue;
-            if (m_options.exchangeFontData && m_serverFontData.empty()) // NOTE: First packet is font data
+            }
+            if (fontPacket) // NOTE: First packet is font data
             {
                 m_serverFontData.swap(m_serverRenderDataBack);
                 m_renderState = RenderState::SetFont;
@@ -941,9 +1852,21 @@ namespace android
 
                     ZSTD_inBuffer input{m_serverRenderDataBack.data() + sizeof(sharedDataSize), packetSize - sizeof(sharedDataSize), 0};
                     ZSTD_outBuffer output{m_serverRenderData.data(), m_serverRenderData.size(), 0};
-                    if (0 != ZSTD_decompressStream(decompressContext.get(), &output, &input))
+                    size_t decompressResult = 0;
+                    phaseStart = std::chrono::steady_clock::now();
+                    {
+                        AIMGUI_TRACE_SCOPE("ZSTD_decompressStream");
+                        decompressResult = ZSTD_decompressStream(decompressContext.get(), &output, &input);
+                    }
+                    if (0 != decompressResult)
                         LogDebug("[-] Server decompression frame data error");
+                    else
+                        m_frameProfiler.Record(AFrameProfiler::Counter::CompressionRatio, static_cast<float>(sharedDataSize) / std::max<size_t>(1, input.size));
+                    m_frameProfiler.Record(AFrameProfiler::Phase::Decompress, phaseStart);
                 }
+                // A dropped frame passes its input on to the next one, published by m_renderState
+                m_serverInputNanoseconds = pendingInputNanoseconds;
+                pendingInputNanoseconds = 0;
                 m_renderState = RenderState::Rendering;
             }
         }
@@ -953,6 +1876,7 @@ namespace android
 
     int AImGui::ReadData(void *buffer, size_t readSize)
     {
+        AIMGUI_TRACE_SCOPE("AImGui::ReadData");
         size_t packetReaded = 0;
         pollfd pfd{
             .fd = m_clientFd,
@@ -975,6 +1899,7 @@ namespace android
     }
     void AImGui::WriteData(void *data, size_t size)
     {
+        AIMGUI_TRACE_SCOPE("AImGui::WriteData");
         write(m_clientFd, data, size);
     }
 } // namespace android
\ No newline at end of file
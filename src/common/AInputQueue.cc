@@ -0,0 +1,47 @@
+#include "AInputQueue.h"
+
+namespace android
+{
+    bool AInputQueue::Push(const ATouchEvent::TouchEvent &event)
+    {
+        auto writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+        if (Capacity <= writeIndex - m_readIndex.load(std::memory_order_acquire))
+        {
+            m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_events[writeIndex & (Capacity - 1)] = event;
+        m_writeIndex.store(writeIndex + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    size_t AInputQueue::Drain(Entry *entries, size_t maxCount)
+    {
+        auto readIndex = m_readIndex.load(std::memory_order_relaxed);
+        auto writeIndex = m_writeIndex.load(std::memory_order_acquire);
+        size_t count = 0;
+
+        for (; readIndex != writeIndex; ++readIndex)
+        {
+            const auto &event = m_events[readIndex & (Capacity - 1)];
+
+            // Only the latest position of consecutive moves matters to ImGui, the latency starts at the first
+            if (0 < count && ATouchEvent::EventType::Move == event.type && ATouchEvent::EventType::Move == entries[count - 1].event.type)
+            {
+                auto &entry = entries[count - 1];
+                entry.previousMove = entry.event;
+                entry.event = event;
+                ++entry.moveCount;
+                continue;
+            }
+            if (maxCount == count)
+                break;
+            entries[count++] = {event, event.timestampNanoseconds, {}, ATouchEvent::EventType::Move == event.type ? 1u : 0u};
+        }
+        m_readIndex.store(readIndex, std::memory_order_release);
+
+        return count;
+    }
+}
@@ -0,0 +1,532 @@
+#include "AOpenGLES3Renderer.h"
+
+#include "Global.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+static constexpr const char *g_vertexShaderSource = R"(#version 300 es
+precision highp float;
+uniform mat4 ProjMtx;
+layout (location = 0) in vec2 Position;
+layout (location = 1) in vec2 UV;
+layout (location = 2) in vec4 Color;
+out vec2 Frag_UV;
+out vec4 Frag_Color;
+void main()
+{
+    Frag_UV = UV;
+    Frag_Color = Color;
+    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);
+}
+)";
+
+static constexpr const char *g_fragmentShaderSource = R"(#version 300 es
+precision mediump float;
+uniform sampler2D Texture;
+in vec2 Frag_UV;
+in vec4 Frag_Color;
+layout (location = 0) out vec4 Out_Color;
+void main()
+{
+    Out_Color = Frag_Color * texture(Texture, Frag_UV.st);
+}
+)";
+
+static GLuint CompileShader(GLenum type, const char *source)
+{
+    auto shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (GL_TRUE != status)
+    {
+        char infoLog[512]{};
+
+        glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+        LogDebug("[-] Renderer compile shader failed: %s", infoLog);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static uint64_t HashString(uint64_t hash, const char *string)
+{
+    for (; nullptr != string && 0 != *string; ++string)
+        hash = (hash ^ static_cast<uint8_t>(*string)) * 0x100000001B3ull;
+
+    return hash;
+}
+
+namespace android
+{
+    AOpenGLES3Renderer::~AOpenGLES3Renderer()
+    {
+        Shutdown();
+    }
+
+    bool AOpenGLES3Renderer::Init(const std::string &programCacheDirectory)
+    {
+        if (m_initialized)
+            return true;
+
+        if (!CreateProgram(programCacheDirectory))
+            return false;
+
+        for (auto &frameBuffers : m_frameBuffers)
+        {
+            glGenVertexArrays(1, &frameBuffers.vertexArray);
+            glGenBuffers(1, &frameBuffers.vertexBuffer);
+            glGenBuffers(1, &frameBuffers.indexBuffer);
+
+            // The attribute layout and element buffer never change, the VAO records them once
+            glBindVertexArray(frameBuffers.vertexArray);
+            glBindBuffer(GL_ARRAY_BUFFER, frameBuffers.vertexBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, frameBuffers.indexBuffer);
+            glEnableVertexAttribArray(0);
+            glEnableVertexAttribArray(1);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), reinterpret_cast<void *>(offsetof(ImDrawVert, pos)));
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), reinterpret_cast<void *>(offsetof(ImDrawVert, uv)));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), reinterpret_cast<void *>(offsetof(ImDrawVert, col)));
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        auto &imguiIO = ImGui::GetIO();
+        imguiIO.BackendRendererName = "AOpenGLES3Renderer";
+        imguiIO.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset; // Indices are rebased on upload
+
+        m_initialized = true;
+        if (!CreateFontsTexture())
+        {
+            Shutdown();
+            return false;
+        }
+
+        return true;
+    }
+
+    void AOpenGLES3Renderer::Shutdown()
+    {
+        if (!m_initialized)
+            return;
+
+        DestroyFontsTexture();
+
+        for (auto &frameBuffers : m_frameBuffers)
+        {
+            if (nullptr != frameBuffers.fence)
+                glDeleteSync(frameBuffers.fence);
+            glDeleteVertexArrays(1, &frameBuffers.vertexArray);
+            glDeleteBuffers(1, &frameBuffers.vertexBuffer);
+            glDeleteBuffers(1, &frameBuffers.indexBuffer);
+
+            frameBuffers = {};
+        }
+        glDeleteProgram(m_program);
+
+        if (nullptr != ImGui::GetCurrentContext())
+        {
+            auto &imguiIO = ImGui::GetIO();
+            imguiIO.BackendRendererName = nullptr;
+            imguiIO.BackendFlags &= ~ImGuiBackendFlags_RendererHasVtxOffset;
+        }
+
+        m_program = 0;
+        m_projectionLocation = -1;
+        m_textureLocation = -1;
+        m_boundTexture = 0;
+        m_frameIndex = 0;
+        m_initialized = false;
+    }
+
+    bool AOpenGLES3Renderer::CreateFontsTexture()
+    {
+        auto &imguiIO = ImGui::GetIO();
+        unsigned char *pixels = nullptr;
+        int width = 0, height = 0;
+
+        imguiIO.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+        glGenTextures(1, &m_fontTexture);
+        glBindTexture(GL_TEXTURE_2D, m_fontTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        m_boundTexture = m_fontTexture;
+
+        imguiIO.Fonts->SetTexID(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(m_fontTexture)));
+
+        return 0 != m_fontTexture;
+    }
+
+    void AOpenGLES3Renderer::DestroyFontsTexture()
+    {
+        if (0 == m_fontTexture)
+            return;
+
+        glDeleteTextures(1, &m_fontTexture);
+        if (nullptr != ImGui::GetCurrentContext())
+            ImGui::GetIO().Fonts->SetTexID(0);
+
+        m_fontTexture = 0;
+        m_boundTexture = 0;
+    }
+
+    void AOpenGLES3Renderer::RenderDrawData(ImDrawData *drawData)
+    {
+        auto framebufferWidth = static_cast<int>(drawData->DisplaySize.x * drawData->FramebufferScale.x);
+        auto framebufferHeight = static_cast<int>(drawData->DisplaySize.y * drawData->FramebufferScale.y);
+        m_drawCallCount = 0;
+        if (!m_initialized || 0 >= framebufferWidth || 0 >= framebufferHeight || 0 == drawData->TotalIdxCount)
+            return;
+
+        // Wait until the GPU released the buffers we are about to overwrite, normally long done
+        auto &frameBuffers = m_frameBuffers[m_frameIndex];
+        m_frameIndex = (m_frameIndex + 1) % RingSize;
+        bool buffersIdle = true;
+        if (nullptr != frameBuffers.fence)
+        {
+            auto waitResult = glClientWaitSync(frameBuffers.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+
+            buffersIdle = GL_ALREADY_SIGNALED == waitResult || GL_CONDITION_SATISFIED == waitResult;
+            if (!buffersIdle)
+                LogDebug("[-] Renderer fence not signaled: 0x%x, mapping synchronized", waitResult);
+            glDeleteSync(frameBuffers.fence);
+            frameBuffers.fence = nullptr;
+        }
+
+        SetupRenderState(drawData, framebufferWidth, framebufferHeight);
+        glBindVertexArray(frameBuffers.vertexArray);
+        if (!UploadDrawData(frameBuffers, drawData, buffersIdle))
+        {
+            glBindVertexArray(0);
+            glDisable(GL_SCISSOR_TEST);
+            return;
+        }
+
+        auto clipOffset = drawData->DisplayPos;
+        auto clipScale = drawData->FramebufferScale;
+
+        DrawCommand pending{};
+        GLsizei indexBase = 0;
+        for (const auto &cmdList : drawData->CmdLists)
+        {
+            for (const auto &cmd : cmdList->CmdBuffer)
+            {
+                if (nullptr != cmd.UserCallback)
+                {
+                    Draw(pending);
+                    pending.indexCount = 0;
+
+                    if (ImDrawCallback_ResetRenderState == cmd.UserCallback)
+                        SetupRenderState(drawData, framebufferWidth, framebufferHeight);
+                    else
+                        cmd.UserCallback(cmdList, &cmd);
+                    continue;
+                }
+
+                auto clipMinX = std::max(0.f, (cmd.ClipRect.x - clipOffset.x) * clipScale.x);
+                auto clipMinY = std::max(0.f, (cmd.ClipRect.y - clipOffset.y) * clipScale.y);
+                auto clipMaxX = std::min(static_cast<float>(framebufferWidth), (cmd.ClipRect.z - clipOffset.x) * clipScale.x);
+                auto clipMaxY = std::min(static_cast<float>(framebufferHeight), (cmd.ClipRect.w - clipOffset.y) * clipScale.y);
+                if (clipMaxX <= clipMinX || clipMaxY <= clipMinY)
+                    continue;
+
+                // GL scissor has its origin at the bottom left corner
+                DrawCommand command{
+                    .scissor = {
+                        static_cast<GLint>(clipMinX),
+                        static_cast<GLint>(framebufferHeight - clipMaxY),
+                        static_cast<GLint>(clipMaxX - clipMinX),
+                        static_cast<GLint>(clipMaxY - clipMinY),
+                    },
+                    .texture = static_cast<GLuint>(reinterpret_cast<intptr_t>(cmd.GetTexID())),
+                    .indexOffset = indexBase + static_cast<GLsizei>(cmd.IdxOffset),
+                    .indexCount = static_cast<GLsizei>(cmd.ElemCount),
+                };
+
+                if (0 != pending.indexCount &&
+                    pending.texture == command.texture &&
+                    0 == memcmp(pending.scissor, command.scissor, sizeof(command.scissor)) &&
+                    pending.indexOffset + pending.indexCount == command.indexOffset)
+                {
+                    pending.indexCount += command.indexCount;
+                    continue;
+                }
+
+                Draw(pending);
+                pending = command;
+            }
+
+            indexBase += cmdList->IdxBuffer.Size;
+        }
+        Draw(pending);
+
+        frameBuffers.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        glBindVertexArray(0);
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    bool AOpenGLES3Renderer::CreateProgram(const std::string &programCacheDirectory)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        GLint binaryFormatCount = 0;
+        std::string cachePath;
+
+        // A binary is only valid for the exact driver build that produced it
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+        if (!programCacheDirectory.empty() && 0 < binaryFormatCount)
+        {
+            auto hash = 0xCBF29CE484222325ull;
+            hash = HashString(hash, reinterpret_cast<const char *>(glGetString(GL_VENDOR)));
+            hash = HashString(hash, reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+            hash = HashString(hash, reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+            hash = HashString(hash, g_vertexShaderSource);
+            hash = HashString(hash, g_fragmentShaderSource);
+
+            char fileName[64]{};
+            snprintf(fileName, sizeof(fileName), "/aimgui_program_%016llx.bin", static_cast<unsigned long long>(hash));
+            cachePath = programCacheDirectory + fileName;
+        }
+
+        auto cacheHit = !cachePath.empty() && LoadProgramBinary(cachePath);
+        if (!cacheHit)
+        {
+            if (!CompileProgram())
+                return false;
+            if (!cachePath.empty())
+                SaveProgramBinary(cachePath);
+        }
+
+        m_projectionLocation = glGetUniformLocation(m_program, "ProjMtx");
+        m_textureLocation = glGetUniformLocation(m_program, "Texture");
+
+        LogInfo("[=] Renderer program ready in %.2fms, %s",
+                std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count(),
+                cacheHit ? "loaded from cache" : "compiled from source");
+
+        return true;
+    }
+
+    bool AOpenGLES3Renderer::LoadProgramBinary(const std::string &cachePath)
+    {
+        auto file = fopen(cachePath.data(), "rb");
+        if (nullptr == file)
+            return false;
+
+        GLenum binaryFormat = 0;
+        std::vector<uint8_t> binary;
+        if (1 == fread(&binaryFormat, sizeof(binaryFormat), 1, file) && 0 == fseek(file, 0, SEEK_END))
+        {
+            auto binarySize = ftell(file) - static_cast<long>(sizeof(binaryFormat));
+            if (0 < binarySize && 0 == fseek(file, sizeof(binaryFormat), SEEK_SET))
+            {
+                binary.resize(binarySize);
+                if (1 != fread(binary.data(), binary.size(), 1, file))
+                    binary.clear();
+            }
+        }
+        fclose(file);
+        if (binary.empty())
+            return false;
+
+        m_program = glCreateProgram();
+        glProgramBinary(m_program, binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+        // Drivers reject binaries after an update, drop it and let the caller compile
+        GLint status = GL_FALSE;
+        glGetProgramiv(m_program, GL_LINK_STATUS, &status);
+        if (GL_TRUE != status)
+        {
+            LogDebug("[-] Renderer program binary rejected: %s", cachePath.data());
+            glDeleteProgram(m_program);
+            m_program = 0;
+            remove(cachePath.data());
+            return false;
+        }
+
+        return true;
+    }
+
+    void AOpenGLES3Renderer::SaveProgramBinary(const std::string &cachePath)
+    {
+        GLint binarySize = 0;
+        glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+        if (0 >= binarySize)
+            return;
+
+        GLenum binaryFormat = 0;
+        std::vector<uint8_t> binary(binarySize);
+        glGetProgramBinary(m_program, binarySize, &binarySize, &binaryFormat, binary.data());
+        if (0 >= binarySize)
+            return;
+
+        // Write aside and rename, a concurrent or interrupted writer never leaves a torn file behind
+        auto temporaryPath = cachePath + ".tmp";
+        auto file = fopen(temporaryPath.data(), "wb");
+        if (nullptr == file)
+        {
+            LogDebug("[-] Renderer can not write program cache: %s", temporaryPath.data());
+            return;
+        }
+        auto written = 1 == fwrite(&binaryFormat, sizeof(binaryFormat), 1, file) && 1 == fwrite(binary.data(), binarySize, 1, file);
+        fclose(file);
+
+        if (!written || 0 != rename(temporaryPath.data(), cachePath.data()))
+            remove(temporaryPath.data());
+    }
+
+    bool AOpenGLES3Renderer::CompileProgram()
+    {
+        auto vertexShader = CompileShader(GL_VERTEX_SHADER, g_vertexShaderSource);
+        auto fragmentShader = CompileShader(GL_FRAGMENT_SHADER, g_fragmentShaderSource);
+        if (0 == vertexShader || 0 == fragmentShader)
+        {
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+            return false;
+        }
+
+        m_program = glCreateProgram();
+        glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(m_program, vertexShader);
+        glAttachShader(m_program, fragmentShader);
+        glLinkProgram(m_program);
+        glDetachShader(m_program, vertexShader);
+        glDetachShader(m_program, fragmentShader);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        GLint status = GL_FALSE;
+        glGetProgramiv(m_program, GL_LINK_STATUS, &status);
+        if (GL_TRUE != status)
+        {
+            char infoLog[512]{};
+
+            glGetProgramInfoLog(m_program, sizeof(infoLog), nullptr, infoLog);
+            LogDebug("[-] Renderer link program failed: %s", infoLog);
+            glDeleteProgram(m_program);
+            m_program = 0;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool AOpenGLES3Renderer::UploadDrawData(FrameBuffers &frameBuffers, const ImDrawData *drawData, bool buffersIdle)
+    {
+        auto vertexBytes = static_cast<GLsizeiptr>(drawData->TotalVtxCount * sizeof(ImDrawVert));
+        auto indexBytes = static_cast<GLsizeiptr>(drawData->TotalIdxCount * sizeof(uint32_t));
+
+        // Grow with headroom so the storage is only respecified when the ui gets larger
+        glBindBuffer(GL_ARRAY_BUFFER, frameBuffers.vertexBuffer);
+        if (frameBuffers.vertexBufferSize < vertexBytes)
+        {
+            frameBuffers.vertexBufferSize = vertexBytes + vertexBytes / 2;
+            glBufferData(GL_ARRAY_BUFFER, frameBuffers.vertexBufferSize, nullptr, GL_STREAM_DRAW);
+        }
+        if (frameBuffers.indexBufferSize < indexBytes)
+        {
+            frameBuffers.indexBufferSize = indexBytes + indexBytes / 2;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, frameBuffers.indexBufferSize, nullptr, GL_STREAM_DRAW);
+        }
+
+        // Once the fence of this slot signaled nothing in flight reads these ranges. Otherwise the
+        // driver is left to synchronize, invalidating the whole buffer lets it orphan the storage.
+        auto mapAccess = GL_MAP_WRITE_BIT | (buffersIdle ? GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT : GL_MAP_INVALIDATE_BUFFER_BIT);
+        auto vertices = static_cast<ImDrawVert *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes, mapAccess));
+        auto indices = static_cast<uint32_t *>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes, mapAccess));
+        if (nullptr == vertices || nullptr == indices)
+        {
+            if (nullptr != vertices)
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            if (nullptr != indices)
+                glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
+            LogDebug("[-] Renderer map buffers failed: %d", glGetError());
+            return false;
+        }
+
+        uint32_t vertexBase = 0;
+        for (const auto &cmdList : drawData->CmdLists)
+        {
+            memcpy(vertices, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
+
+            for (const auto &cmd : cmdList->CmdBuffer)
+            {
+                if (nullptr != cmd.UserCallback)
+                    continue;
+
+                auto source = cmdList->IdxBuffer.Data + cmd.IdxOffset;
+                auto destination = indices + cmd.IdxOffset;
+                auto rebase = vertexBase + cmd.VtxOffset;
+                for (unsigned int i = 0; i < cmd.ElemCount; ++i)
+                    destination[i] = source[i] + rebase;
+            }
+
+            vertices += cmdList->VtxBuffer.Size;
+            indices += cmdList->IdxBuffer.Size;
+            vertexBase += static_cast<uint32_t>(cmdList->VtxBuffer.Size);
+        }
+
+        auto vertexResult = glUnmapBuffer(GL_ARRAY_BUFFER);
+        auto indexResult = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
+        return GL_TRUE == vertexResult && GL_TRUE == indexResult;
+    }
+
+    void AOpenGLES3Renderer::SetupRenderState(const ImDrawData *drawData, int framebufferWidth, int framebufferHeight)
+    {
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        glEnable(GL_SCISSOR_TEST);
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+        float left = drawData->DisplayPos.x;
+        float right = drawData->DisplayPos.x + drawData->DisplaySize.x;
+        float top = drawData->DisplayPos.y;
+        float bottom = drawData->DisplayPos.y + drawData->DisplaySize.y;
+        const float orthoProjection[4][4] = {
+            {2.f / (right - left), 0.f, 0.f, 0.f},
+            {0.f, 2.f / (top - bottom), 0.f, 0.f},
+            {0.f, 0.f, -1.f, 0.f},
+            {(right + left) / (left - right), (top + bottom) / (bottom - top), 0.f, 1.f},
+        };
+
+        glUseProgram(m_program);
+        glUniform1i(m_textureLocation, 0);
+        glUniformMatrix4fv(m_projectionLocation, 1, GL_FALSE, &orthoProjection[0][0]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_boundTexture);
+    }
+
+    void AOpenGLES3Renderer::Draw(const DrawCommand &command)
+    {
+        if (0 == command.indexCount)
+            return;
+
+        if (m_boundTexture != command.texture)
+        {
+            glBindTexture(GL_TEXTURE_2D, command.texture);
+            m_boundTexture = command.texture;
+        }
+        glScissor(command.scissor[0], command.scissor[1], command.scissor[2], command.scissor[3]);
+        glDrawElements(GL_TRIANGLES, command.indexCount, GL_UNSIGNED_INT, reinterpret_cast<void *>(command.indexOffset * sizeof(uint32_t)));
+        ++m_drawCallCount;
+    }
+}
@@ -2,6 +2,14 @@
 
 #include "Global.h"
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+
 int g_scanCodeMapping[] = {
     AKEYCODE_UNKNOWN, // Make scan codes mapping array start index with 1
     AKEYCODE_ESCAPE,
@@ -283,13 +291,99 @@ namespace android
     }
 }
 
+namespace
+{
+    // A recording is the header followed by chunks, each one a RecordChunkType and its structure
+    constexpr char g_recordMagic[8] = {'A', 'I', 'M', 'G', 'U', 'I', 'E', 'V'};
+    constexpr uint32_t g_recordVersion = 1;
+
+    struct RecordHeader
+    {
+        char magic[8];
+        uint32_t version;
+    };
+
+    enum RecordChunkType : uint32_t
+    {
+        RecordChunkDevice = 1,
+        RecordChunkEvent = 2,
+    };
+
+    struct RecordDeviceChunk
+    {
+        uint32_t id;
+        uint32_t classes;
+        int32_t absXMinimum, absXMaximum;
+        int32_t absYMinimum, absYMaximum;
+        char name[128];
+    };
+
+    struct RecordEventChunk
+    {
+        uint32_t id;
+        uint16_t type;
+        uint16_t code;
+        int32_t value;
+        int64_t timestampNanoseconds; // The devices use CLOCK_MONOTONIC
+    };
+}
+
 namespace android
 {
     int ATouchEvent::transformScalerX = -1;
     int ATouchEvent::transformScalerY = -1;
 
+    static uint32_t ClassifyDevice(int deviceFd)
+    {
+        typename detail::BitArray<KEY_MAX>::Buffer keyBitBuffer{};
+        typename detail::BitArray<REL_MAX>::Buffer relBitBuffer{};
+        typename detail::BitArray<ABS_MAX>::Buffer absBitBuffer{};
+        detail::BitArray<KEY_MAX> keyBitmask;
+        detail::BitArray<REL_MAX> relBitmask;
+        detail::BitArray<ABS_MAX> absBitmask;
+
+        ioctl(deviceFd, EVIOCGBIT(EV_KEY, keyBitmask.bytes()), keyBitBuffer.data());
+        ioctl(deviceFd, EVIOCGBIT(EV_REL, relBitmask.bytes()), relBitBuffer.data());
+        ioctl(deviceFd, EVIOCGBIT(EV_ABS, absBitmask.bytes()), absBitBuffer.data());
+        keyBitmask.loadFromBuffer(keyBitBuffer);
+        relBitmask.loadFromBuffer(relBitBuffer);
+        absBitmask.loadFromBuffer(absBitBuffer);
+
+        uint32_t classes = 0;
+        if ((keyBitmask.test(BTN_TOUCH) || keyBitmask.test(BTN_TOOL_FINGER)) && absBitmask.test(ABS_MT_POSITION_X))
+            classes |= ATouchEvent::DeviceClassTouch;
+        if (keyBitmask.any(KEY_RESERVED, BTN_MISC))
+            classes |= ATouchEvent::DeviceClassKeyboard;
+        if (relBitmask.test(REL_WHEEL) || relBitmask.test(REL_HWHEEL))
+            classes |= ATouchEvent::DeviceClassMouse;
+
+        return classes;
+    }
+
+    // Map a position of a panel onto 0..sharedMaximum, the range every touch event is reported in
+    static int NormalizeAxis(int value, const input_absinfo &range, int sharedMaximum)
+    {
+        if (range.maximum <= range.minimum || 0 >= sharedMaximum)
+            return value;
+
+        return static_cast<int>(static_cast<int64_t>(value - range.minimum) * sharedMaximum / (range.maximum - range.minimum));
+    }
+
     ATouchEvent::ATouchEvent()
     {
+        InitEpoll();
+        if (-1 == m_epollFd)
+            return;
+
+        m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (-1 == m_inotifyFd || -1 == inotify_add_watch(m_inotifyFd, "/dev/input", IN_CREATE | IN_DELETE | IN_ATTRIB))
+            LogDebug("[-] Could not watch /dev/input for hotplug due to error %d : %s", errno, strerror(errno));
+        else
+        {
+            epoll_event inotifyEvent{.events = EPOLLIN, .data = {.ptr = nullptr}};
+            epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_inotifyFd, &inotifyEvent);
+        }
+
         std::error_code errorCode;
         if (!std::filesystem::exists("/dev/input", errorCode))
         {
@@ -299,100 +393,322 @@ namespace android
             return;
         }
 
-        for (const auto &devicePath : std::filesystem::directory_iterator("/dev/input"))
+        for (const auto &devicePath : std::filesystem::directory_iterator("/dev/input", errorCode))
         {
             if (std::string::npos == devicePath.path().filename().string().find("event"))
                 continue;
 
-            m_deviceFd = open(devicePath.path().c_str(), O_RDONLY | O_SYNC | O_NONBLOCK);
-            if (-1 == m_deviceFd)
+            OpenDevice(devicePath.path().string());
+        }
+
+        if (m_devices.end() == std::find_if(m_devices.begin(), m_devices.end(), [](const auto &device)
+                                            { return device->classes & DeviceClassTouch; }))
+            LogDebug("[-] Could not find the touch event device.");
+    }
+
+    ATouchEvent::ATouchEvent(const std::string &replayPath, float replaySpeed)
+    {
+        InitEpoll();
+        if (-1 != m_epollFd)
+            StartReplay(replayPath, replaySpeed);
+    }
+
+    ATouchEvent::~ATouchEvent()
+    {
+        StopRecording();
+        if (m_replayThread)
+        {
             {
-                LogDebug("[-] Could not open file %s due to error %d : %s", devicePath.path().c_str(), errno, strerror(errno));
-                continue;
+                std::lock_guard lock(m_replayMutex);
+                m_replayStopping = true;
             }
+            m_replayCondition.notify_all();
+            m_replayThread->join();
+        }
 
-            ioctl(m_deviceFd, EVIOCGBIT(EV_KEY, m_keyBitmask.bytes()), m_keyBitBuffer.data());
-            m_keyBitmask.loadFromBuffer(m_keyBitBuffer);
+        for (const auto &device : m_devices)
+            close(device->fd);
+        m_devices.clear();
 
-            if (m_keyBitmask.test(BTN_TOUCH) || m_keyBitmask.test(BTN_TOOL_FINGER))
-                break;
+        if (-1 != m_inotifyFd)
+            close(m_inotifyFd);
+        if (-1 != m_wakeFd)
+            close(m_wakeFd);
+        if (-1 != m_epollFd)
+            close(m_epollFd);
+    }
 
-            close(m_deviceFd);
-            m_deviceFd = -1;
+    void ATouchEvent::InitEpoll()
+    {
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (-1 == m_epollFd)
+        {
+            LogDebug("[-] Could not create epoll instance due to error %d : %s", errno, strerror(errno));
+            return;
         }
 
-        if (-1 == m_deviceFd)
+        // Its own address tags the wake eventfd in epoll, nullptr tags inotify and anything else a device
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (-1 != m_wakeFd)
         {
-            LogDebug("[-] Could not find the touch event device.");
+            epoll_event wakeEvent{.events = EPOLLIN, .data = {.ptr = &m_wakeFd}};
+            epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &wakeEvent);
+        }
+    }
+
+    void ATouchEvent::OpenDevice(const std::string &path)
+    {
+        if (-1 == m_epollFd)
             return;
+        for (const auto &device : m_devices)
+        {
+            if (device->path == path)
+                return;
         }
 
-        int buffer[6]{};
-        ioctl(m_deviceFd, EVIOCGABS(ABS_MT_POSITION_X), buffer);
-        transformScalerX = buffer[2];
+        // A node that just appeared may not be readable yet, its IN_ATTRIB retries the open
+        auto deviceFd = open(path.data(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (-1 == deviceFd)
+        {
+            LogDebug("[-] Could not open file %s due to error %d : %s", path.data(), errno, strerror(errno));
+            return;
+        }
+
+        auto classes = ClassifyDevice(deviceFd);
+        if (0 == classes)
+        {
+            close(deviceFd);
+            return;
+        }
 
-        ioctl(m_deviceFd, EVIOCGABS(ABS_MT_POSITION_Y), buffer);
-        transformScalerY = buffer[2];
+        // Event timestamps default to CLOCK_REALTIME, latency is measured against the monotonic clock
+        int clockId = CLOCK_MONOTONIC;
+        if (-1 == ioctl(deviceFd, EVIOCSCLOCKID, &clockId))
+            LogDebug("[-] Could not set the clock of %s due to error %d : %s", path.data(), errno, strerror(errno));
+
+        auto device = std::make_unique<Device>();
+        char deviceName[128]{};
+        ioctl(deviceFd, EVIOCGNAME(sizeof(deviceName) - 1), deviceName);
+        device->fd = deviceFd;
+        device->path = path;
+        device->name = deviceName;
+        device->classes = classes;
+
+        if (classes & DeviceClassTouch)
+        {
+            // Protocol B only reports ABS_MT_SLOT when it changes, start from the one the kernel is on
+            input_absinfo slotInfo{};
+            if (0 == ioctl(deviceFd, EVIOCGABS(ABS_MT_SLOT), &slotInfo))
+                device->currentSlot = 0 <= slotInfo.value && MaxTouchSlots > static_cast<size_t>(slotInfo.value) ? slotInfo.value : -1;
+        }
+        if (classes & DeviceClassTouch)
+        {
+            ioctl(deviceFd, EVIOCGABS(ABS_MT_POSITION_X), &device->absX);
+            ioctl(deviceFd, EVIOCGABS(ABS_MT_POSITION_Y), &device->absY);
+        }
+
+        AddDevice(std::move(device));
     }
 
-    ATouchEvent::~ATouchEvent()
+    void ATouchEvent::AddDevice(std::unique_ptr<Device> device)
     {
-        if (-1 != m_deviceFd)
-            close(m_deviceFd);
+        // The first panel sets the range of every touch event, the positions of others are rescaled to it
+        if ((device->classes & DeviceClassTouch) && (0 >= transformScalerX || 0 >= transformScalerY))
+        {
+            transformScalerX = device->absX.maximum;
+            transformScalerY = device->absY.maximum;
+        }
+
+        epoll_event deviceEvent{.events = EPOLLIN, .data = {.ptr = device.get()}};
+        if (-1 == epoll_ctl(m_epollFd, EPOLL_CTL_ADD, device->fd, &deviceEvent))
+        {
+            LogDebug("[-] Could not add %s to epoll due to error %d : %s", device->path.data(), errno, strerror(errno));
+            close(device->fd);
+            return;
+        }
+
+        device->id = m_nextDeviceId++;
+        LogInfo("[+] Input device %s (%s) opened, classes:%x", device->path.data(), device->name.data(), device->classes);
+        if (nullptr != m_recordFile)
+            RecordDevice(*device);
+        m_devices.push_back(std::move(device));
     }
 
-    bool ATouchEvent::GetRawEvent(input_event *event)
+    void ATouchEvent::CloseDevice(Device *device)
     {
-        if (-1 == m_deviceFd)
-            return false;
+        auto iterator = std::find_if(m_devices.begin(), m_devices.end(), [device](const auto &openDevice)
+                                     { return openDevice.get() == device; });
+        if (m_devices.end() == iterator)
+            return;
 
-        if (0 >= read(m_deviceFd, event, sizeof(input_event)))
-            return false;
+        LogInfo("[=] Input device %s (%s) closed", device->path.data(), device->name.data());
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, device->fd, nullptr);
+        close(device->fd);
+        m_devices.erase(iterator);
+    }
 
-        return true;
+    void ATouchEvent::ProcessHotplug()
+    {
+        alignas(inotify_event) char buffer[4096];
+
+        while (true)
+        {
+            auto readResult = read(m_inotifyFd, buffer, sizeof(buffer));
+            if (0 >= readResult)
+                break;
+
+            for (ssize_t offset = 0; offset < readResult;)
+            {
+                auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                if (0 == event->len || 0 != strncmp(event->name, "event", 5))
+                    continue;
+
+                auto path = std::string("/dev/input/") + event->name;
+                if (event->mask & IN_DELETE)
+                {
+                    for (const auto &device : m_devices)
+                    {
+                        if (device->path == path)
+                        {
+                            CloseDevice(device.get());
+                            break;
+                        }
+                    }
+                }
+                else
+                    OpenDevice(path);
+            }
+        }
     }
 
-    bool ATouchEvent::GetTouchEvent(TouchEvent *touchEvent)
+    void ATouchEvent::ReadDevice(Device *device)
     {
-        static std::vector<input_event> cachedEventQueue;
-        static int lastTouchPointX = 0, lastTouchPointY = 0;
+        // A report emits at most one event per input_event it holds, so the queue must keep room for the
+        // part already pending plus everything read. What is left stays in the kernel for the next poll.
+        while (m_touchEventCount + device->pendingEventCount < m_touchEvents.size())
+        {
+            auto readCount = std::min(m_readBuffer.size(), m_touchEvents.size() - m_touchEventCount - device->pendingEventCount);
+            auto readResult = read(device->fd, m_readBuffer.data(), readCount * sizeof(input_event));
+            if (0 < readResult)
+            {
+                auto eventCount = static_cast<size_t>(readResult) / sizeof(input_event);
+                for (size_t i = 0; i < eventCount; ++i)
+                {
+                    if (nullptr != m_recordFile)
+                        RecordEvent(*device, m_readBuffer[i]);
+                    ProcessDeviceEvent(device, m_readBuffer[i]);
+                }
+                if (eventCount < readCount)
+                    break; // Drained
+                continue;
+            }
 
-        if (-1 == m_deviceFd)
-            return false;
+            // ENODEV arrives before the inotify removal when a device is unplugged
+            if (-1 == readResult && (EAGAIN == errno || EINTR == errno))
+                break;
+            CloseDevice(device);
+            break;
+        }
+    }
 
-        input_event event{};
-        if (0 >= read(m_deviceFd, &event, sizeof(input_event)))
+    bool ATouchEvent::PollDevices(int timeoutMilliseconds)
+    {
+        if (-1 == m_epollFd)
             return false;
 
+        epoll_event events[16];
+        auto eventCount = epoll_wait(m_epollFd, events, std::size(events), timeoutMilliseconds);
+
+        // Hotplug goes last so that no ready entry of this batch points to a closed device
+        bool hotplug = false, interrupted = false;
+        for (int i = 0; i < eventCount; ++i)
+        {
+            if (nullptr == events[i].data.ptr)
+                hotplug = true;
+            else if (&m_wakeFd == events[i].data.ptr)
+            {
+                eventfd_t value = 0;
+                eventfd_read(m_wakeFd, &value);
+                interrupted = true;
+            }
+            else
+                ReadDevice(static_cast<Device *>(events[i].data.ptr));
+        }
+        if (hotplug)
+            ProcessHotplug();
+
+        return interrupted;
+    }
+
+    void ATouchEvent::ProcessDeviceEvent(Device *device, const input_event &event)
+    {
+        // The kernel buffer overflowed, the report in progress is incomplete
+        if (EV_SYN == event.type && SYN_DROPPED == event.code)
+        {
+            device->pendingEventCount = 0;
+            device->droppingPacket = true;
+            return;
+        }
+
         // Check if event is not a submit event
         if (EV_SYN != event.type || SYN_REPORT != event.code || 0 != event.value)
         {
-            cachedEventQueue.push_back(event);
-            return false;
+            if (device->droppingPacket)
+                return;
+            if (device->pendingEvents.size() <= device->pendingEventCount)
+            {
+                LogDebug("[-] Input report of %s exceeds %zu events, dropped", device->path.data(), MaxPacketEvents);
+                device->pendingEventCount = 0;
+                device->droppingPacket = true;
+                return;
+            }
+
+            device->pendingEvents[device->pendingEventCount++] = event;
+            return;
         }
-        else if (cachedEventQueue.empty())
-            return false;
+        else if (device->droppingPacket)
+        {
+            device->droppingPacket = false;
+            return;
+        }
+        else if (0 == device->pendingEventCount)
+            return;
 
-        touchEvent->type = EventType::Move;
-        touchEvent->x = lastTouchPointX;
-        touchEvent->y = lastTouchPointY;
-        touchEvent->keyCode = 0;
-        for (const auto &processEvent : cachedEventQueue)
+        // Keys are reported in order, touch contacts and relative axes once the whole report is applied
+        device->reportNanoseconds = static_cast<int64_t>(event.input_event_sec) * 1000000000ll + event.input_event_usec * 1000ll;
+        TouchEvent relativeEvent{};
+        bool relativeChanged = false, touchChanged = false;
+        relativeEvent.type = EventType::Move;
+        relativeEvent.x = device->lastTouchPointX;
+        relativeEvent.y = device->lastTouchPointY;
+        relativeEvent.timestampNanoseconds = device->reportNanoseconds;
+        for (size_t i = 0; i < device->pendingEventCount; ++i)
         {
+            const auto &processEvent = device->pendingEvents[i];
             switch (processEvent.type)
             {
             case EV_KEY:
             {
                 if (BTN_TOUCH == processEvent.code || BTN_TOOL_FINGER == processEvent.code)
                 {
-                    touchEvent->type = 1 == processEvent.value ? EventType::TouchDown : EventType::TouchUp;
+                    if (!device->hasTrackingId && 0 == device->currentSlot)
+                    {
+                        device->slots[0].trackingId = 1 == processEvent.value ? 0 : -1;
+                        touchChanged = true;
+                    }
                     break;
                 }
-                else if (KEY_RESERVED <= processEvent.code && sizeof(g_scanCodeMapping) > processEvent.code)
+                else if (KEY_RESERVED <= processEvent.code && std::size(g_scanCodeMapping) > processEvent.code)
                 {
-                    touchEvent->scanCode = processEvent.code;
-                    touchEvent->keyCode = g_scanCodeMapping[touchEvent->scanCode];
-                    touchEvent->type = 1 == processEvent.value ? EventType::KeyDown : EventType::KeyUp;
+                    TouchEvent keyEvent{};
+                    keyEvent.scanCode = processEvent.code;
+                    keyEvent.keyCode = g_scanCodeMapping[keyEvent.scanCode];
+                    keyEvent.type = 1 == processEvent.value ? EventType::KeyDown : EventType::KeyUp;
+                    keyEvent.x = device->lastTouchPointX;
+                    keyEvent.y = device->lastTouchPointY;
+                    keyEvent.timestampNanoseconds = static_cast<int64_t>(processEvent.input_event_sec) * 1000000000ll + processEvent.input_event_usec * 1000ll;
+                    PushTouchEvent(keyEvent);
                 }
 
                 break;
@@ -401,42 +717,555 @@ namespace android
             {
                 switch (processEvent.code)
                 {
-                case 6:
-                    touchEvent->y = processEvent.value;
-                    touchEvent->type = EventType::Wheel;
+                case REL_HWHEEL:
+                    relativeEvent.y = processEvent.value;
+                    relativeEvent.type = EventType::Wheel;
+                    relativeChanged = true;
                     break;
-                case 8:
-                    touchEvent->x = processEvent.value;
+                case REL_WHEEL:
+                    relativeEvent.x = processEvent.value;
+                    relativeChanged = true;
                     break;
                 default:
                     break;
                 }
+
+                break;
             }
             case EV_ABS:
             {
-                if (ABS_MT_SLOT == processEvent.code && 0 != processEvent.value) // Filter multi touch(Unsupported)
+                if (ABS_MT_SLOT == processEvent.code)
                 {
-                    cachedEventQueue.clear();
-                    return false;
+                    device->currentSlot = 0 <= processEvent.value && MaxTouchSlots > static_cast<size_t>(processEvent.value) ? processEvent.value : -1;
+                    break;
                 }
+                if (-1 == device->currentSlot)
+                    break;
 
-                if (ABS_MT_POSITION_X == processEvent.code)
+                auto &slot = device->slots[device->currentSlot];
+                if (ABS_MT_TRACKING_ID == processEvent.code)
                 {
-                    touchEvent->x = processEvent.value;
-                    lastTouchPointX = touchEvent->x;
+                    device->hasTrackingId = true;
+                    slot.trackingId = processEvent.value;
+                    touchChanged = true;
+                }
+                else if (ABS_MT_POSITION_X == processEvent.code)
+                {
+                    slot.x = NormalizeAxis(processEvent.value, device->absX, transformScalerX);
+                    touchChanged = true;
                 }
                 else if (ABS_MT_POSITION_Y == processEvent.code)
                 {
-                    touchEvent->y = processEvent.value;
-                    lastTouchPointY = touchEvent->y;
+                    slot.y = NormalizeAxis(processEvent.value, device->absY, transformScalerY);
+                    touchChanged = true;
                 }
+
+                break;
             }
             default:
                 break;
             }
         }
-        cachedEventQueue.clear();
+        device->pendingEventCount = 0;
+
+        if (touchChanged)
+            ProcessTouchSlots(device);
+        if (relativeChanged)
+            PushTouchEvent(relativeEvent);
+    }
+
+    void ATouchEvent::ProcessTouchSlots(Device *device)
+    {
+        size_t activeCount = 0;
+        for (const auto &slot : device->slots)
+        {
+            if (-1 != slot.trackingId)
+                ++activeCount;
+        }
+
+        if (GestureState::None != device->gestureState)
+        {
+            if (0 == activeCount)
+                device->gestureState = GestureState::None;
+            else
+                ProcessGesture(device);
+            return;
+        }
+
+        TouchEvent touchEvent{};
+        touchEvent.timestampNanoseconds = device->reportNanoseconds;
+        if (-1 == device->primarySlot)
+        {
+            if (0 == activeCount)
+                return;
+
+            // Both fingers landed in the same report, there is no pointer to release
+            if (1 < activeCount)
+            {
+                ProcessGesture(device);
+                return;
+            }
+
+            for (size_t i = 0; i < device->slots.size(); ++i)
+            {
+                if (-1 == device->slots[i].trackingId)
+                    continue;
+
+                device->primarySlot = static_cast<int>(i);
+                device->primaryTrackingId = device->slots[i].trackingId;
+                break;
+            }
+
+            const auto &slot = device->slots[device->primarySlot];
+            touchEvent.type = EventType::TouchDown;
+            touchEvent.x = device->lastTouchPointX = slot.x;
+            touchEvent.y = device->lastTouchPointY = slot.y;
+            PushTouchEvent(touchEvent);
+            return;
+        }
+
+        const auto &primary = device->slots[device->primarySlot];
+        if (primary.trackingId != device->primaryTrackingId)
+        {
+            touchEvent.type = EventType::TouchUp;
+            touchEvent.x = device->lastTouchPointX;
+            touchEvent.y = device->lastTouchPointY;
+            PushTouchEvent(touchEvent);
+
+            // The remaining fingers do not take the pointer over, it would jump under them
+            device->primarySlot = -1;
+            if (0 != activeCount)
+                device->gestureState = GestureState::Ended;
+            return;
+        }
+
+        if (1 < activeCount)
+        {
+            // Release outside of the screen so that the widget under the first finger is not clicked
+            touchEvent.type = EventType::TouchUp;
+            touchEvent.x = -1;
+            touchEvent.y = -1;
+            PushTouchEvent(touchEvent);
+
+            device->primarySlot = -1;
+            ProcessGesture(device);
+            return;
+        }
+
+        if (primary.x == device->lastTouchPointX && primary.y == device->lastTouchPointY)
+            return;
+        touchEvent.type = EventType::Move;
+        touchEvent.x = device->lastTouchPointX = primary.x;
+        touchEvent.y = device->lastTouchPointY = primary.y;
+        PushTouchEvent(touchEvent);
+    }
+
+    void ATouchEvent::ProcessGesture(Device *device)
+    {
+        if (GestureState::Ended == device->gestureState)
+            return;
+
+        auto starting = GestureState::None == device->gestureState;
+        if (starting)
+        {
+            size_t gestureSlotCount = 0;
+            for (size_t i = 0; i < device->slots.size() && 2 > gestureSlotCount; ++i)
+            {
+                if (-1 != device->slots[i].trackingId)
+                    device->gestureSlots[gestureSlotCount++] = static_cast<int>(i);
+            }
+            device->gestureState = GestureState::Pending;
+        }
+
+        const auto &first = device->slots[device->gestureSlots[0]];
+        const auto &second = device->slots[device->gestureSlots[1]];
+        if (-1 == first.trackingId || -1 == second.trackingId)
+        {
+            device->gestureState = GestureState::Ended;
+            return;
+        }
+
+        auto centerX = (first.x + second.x) / 2.f, centerY = (first.y + second.y) / 2.f;
+        auto distance = std::hypot(static_cast<float>(first.x - second.x), static_cast<float>(first.y - second.y));
+        if (starting)
+        {
+            device->gestureStartDistance = device->gestureDistance = distance;
+            device->gestureStartCenterX = device->gestureCenterX = centerX;
+            device->gestureStartCenterY = device->gestureCenterY = centerY;
+            return;
+        }
+
+        TouchEvent touchEvent{};
+        touchEvent.timestampNanoseconds = device->reportNanoseconds;
+        touchEvent.x = static_cast<int>(centerX);
+        touchEvent.y = static_cast<int>(centerY);
+        if (GestureState::Pending == device->gestureState)
+        {
+            // The slop is a fraction of the panel so it feels the same on every resolution
+            auto slop = std::max(transformScalerX, transformScalerY) / 40.f;
+            if (slop < std::abs(distance - device->gestureStartDistance))
+                device->gestureState = GestureState::Pinch;
+            else if (slop < std::hypot(centerX - device->gestureStartCenterX, centerY - device->gestureStartCenterY))
+                device->gestureState = GestureState::Scroll;
+            else
+                return;
+        }
+
+        if (GestureState::Pinch == device->gestureState && 0.f < device->gestureDistance)
+        {
+            touchEvent.type = EventType::Pinch;
+            touchEvent.scale = distance / device->gestureDistance;
+            PushTouchEvent(touchEvent);
+        }
+        else if (GestureState::Scroll == device->gestureState)
+        {
+            touchEvent.type = EventType::Scroll;
+            touchEvent.deltaX = centerX - device->gestureCenterX;
+            touchEvent.deltaY = centerY - device->gestureCenterY;
+            PushTouchEvent(touchEvent);
+        }
+        device->gestureDistance = distance;
+        device->gestureCenterX = centerX;
+        device->gestureCenterY = centerY;
+    }
+
+    void ATouchEvent::PushTouchEvent(const TouchEvent &touchEvent)
+    {
+        if (m_touchEventCount < m_touchEvents.size())
+        {
+            m_touchEvents[m_touchEventCount++] = touchEvent;
+            return;
+        }
+
+        ++m_droppedEventCount;
+        LogDebug("[-] Input event queue is full, event type %u dropped", static_cast<uint32_t>(touchEvent.type));
+    }
+
+    bool ATouchEvent::GetRawEvent(input_event *event)
+    {
+        if (-1 == m_epollFd)
+            return false;
+
+        epoll_event readyEvent{};
+        if (0 >= epoll_wait(m_epollFd, &readyEvent, 1, 0))
+            return false;
+        if (nullptr == readyEvent.data.ptr)
+        {
+            ProcessHotplug();
+            return false;
+        }
+        if (&m_wakeFd == readyEvent.data.ptr)
+        {
+            eventfd_t value = 0;
+            eventfd_read(m_wakeFd, &value);
+            return false;
+        }
+
+        auto device = static_cast<Device *>(readyEvent.data.ptr);
+        auto readResult = read(device->fd, event, sizeof(input_event));
+        if (static_cast<ssize_t>(sizeof(input_event)) == readResult)
+        {
+            if (nullptr != m_recordFile)
+                RecordEvent(*device, *event);
+            return true;
+        }
+
+        if (-1 == readResult && (EAGAIN == errno || EINTR == errno))
+            return false;
+        CloseDevice(device);
+
+        return false;
+    }
+
+    bool ATouchEvent::GetTouchEvent(TouchEvent *touchEvent)
+    {
+        return WaitTouchEvent(touchEvent, 0);
+    }
+
+    bool ATouchEvent::WaitTouchEvent(TouchEvent *touchEvent, int timeoutMilliseconds)
+    {
+        if (-1 == m_epollFd)
+            return false;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeoutMilliseconds, 0));
+
+        while (m_touchEventIndex >= m_touchEventCount)
+        {
+            m_touchEventIndex = m_touchEventCount = 0;
+            auto interrupted = PollDevices(timeoutMilliseconds);
+            if (0 != m_touchEventCount)
+                break;
+            if (interrupted || 0 == timeoutMilliseconds)
+                return false;
+
+            // Woken by a partial report or a hotplug, keep waiting for the rest of the timeout
+            if (0 < timeoutMilliseconds)
+            {
+                timeoutMilliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+                if (0 >= timeoutMilliseconds)
+                    return false;
+            }
+        }
+
+        *touchEvent = m_touchEvents[m_touchEventIndex++];
+
+        return true;
+    }
+
+    void ATouchEvent::Interrupt()
+    {
+        if (-1 != m_wakeFd)
+            eventfd_write(m_wakeFd, 1);
+    }
+    bool ATouchEvent::StartRecording(const std::string &path)
+    {
+        StopRecording();
+
+        m_recordFile = fopen(path.data(), "wb");
+        if (nullptr == m_recordFile)
+        {
+            LogDebug("[-] Could not create input recording %s due to error %d : %s", path.data(), errno, strerror(errno));
+            return false;
+        }
+
+        RecordHeader header{};
+        memcpy(header.magic, g_recordMagic, sizeof(header.magic));
+        header.version = g_recordVersion;
+        fwrite(&header, sizeof(header), 1, m_recordFile);
+        for (const auto &device : m_devices)
+            RecordDevice(*device);
+
+        LogInfo("[+] Recording input events to %s", path.data());
+        return true;
+    }
+
+    void ATouchEvent::StopRecording()
+    {
+        if (nullptr == m_recordFile)
+            return;
+
+        fclose(m_recordFile);
+        m_recordFile = nullptr;
+    }
+
+    void ATouchEvent::RecordDevice(const Device &device)
+    {
+        RecordChunkType chunkType = RecordChunkDevice;
+        RecordDeviceChunk chunk{};
+        chunk.id = device.id;
+        chunk.classes = device.classes;
+        chunk.absXMinimum = device.absX.minimum;
+        chunk.absXMaximum = device.absX.maximum;
+        chunk.absYMinimum = device.absY.minimum;
+        chunk.absYMaximum = device.absY.maximum;
+        strncpy(chunk.name, device.name.data(), sizeof(chunk.name) - 1);
+
+        fwrite(&chunkType, sizeof(chunkType), 1, m_recordFile);
+        fwrite(&chunk, sizeof(chunk), 1, m_recordFile);
+    }
+
+    void ATouchEvent::RecordEvent(const Device &device, const input_event &event)
+    {
+        RecordChunkType chunkType = RecordChunkEvent;
+        RecordEventChunk chunk{};
+        chunk.id = device.id;
+        chunk.type = event.type;
+        chunk.code = event.code;
+        chunk.value = event.value;
+        chunk.timestampNanoseconds = static_cast<int64_t>(event.input_event_sec) * 1000000000ll + event.input_event_usec * 1000ll;
+
+        fwrite(&chunkType, sizeof(chunkType), 1, m_recordFile);
+        fwrite(&chunk, sizeof(chunk), 1, m_recordFile);
+    }
+
+    bool ATouchEvent::StartReplay(const std::string &path, float speed)
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.data(), "rb"), &fclose);
+        if (nullptr == file)
+        {
+            LogDebug("[-] Could not open input recording %s due to error %d : %s", path.data(), errno, strerror(errno));
+            return false;
+        }
+
+        uint8_t buffer[4096];
+        for (size_t readSize = 0; 0 < (readSize = fread(buffer, 1, sizeof(buffer), file.get()));)
+            m_replayData.insert(m_replayData.end(), buffer, buffer + readSize);
+
+        RecordHeader header{};
+        if (sizeof(header) <= m_replayData.size())
+            memcpy(&header, m_replayData.data(), sizeof(header));
+        if (0 != memcmp(header.magic, g_recordMagic, sizeof(header.magic)) || g_recordVersion != header.version)
+        {
+            LogDebug("[-] %s is not an input recording of version %u", path.data(), g_recordVersion);
+            m_replayData.clear();
+            return false;
+        }
+
+        // Devices plugged in while recording are created up front, they stay silent until their first event
+        for (size_t offset = sizeof(header); offset + sizeof(RecordChunkType) <= m_replayData.size();)
+        {
+            RecordChunkType chunkType{};
+            memcpy(&chunkType, m_replayData.data() + offset, sizeof(chunkType));
+            offset += sizeof(chunkType);
+            if (RecordChunkEvent == chunkType)
+            {
+                offset += sizeof(RecordEventChunk);
+                continue;
+            }
+            if (RecordChunkDevice != chunkType || offset + sizeof(RecordDeviceChunk) > m_replayData.size())
+                break;
+
+            RecordDeviceChunk chunk{};
+            memcpy(&chunk, m_replayData.data() + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            chunk.name[sizeof(chunk.name) - 1] = '\0';
+
+            // The ids index m_replayFds, a corrupt recording must not make it huge
+            if (MaxReplayDeviceId < chunk.id)
+            {
+                LogDebug("[-] %s names device %u past %u, stopping the replay", path.data(), chunk.id, MaxReplayDeviceId);
+                CloseReplayPipes();
+                m_replayData.clear();
+                return false;
+            }
+
+            int pipeFds[2];
+            if (-1 == pipe2(pipeFds, O_CLOEXEC | O_NONBLOCK))
+            {
+                LogDebug("[-] Could not create replay pipe due to error %d : %s", errno, strerror(errno));
+                continue;
+            }
+            if (m_replayFds.size() <= chunk.id)
+                m_replayFds.resize(chunk.id + 1, -1);
+            if (-1 != m_replayFds[chunk.id])
+                close(m_replayFds[chunk.id]);
+            m_replayFds[chunk.id] = pipeFds[1];
+
+            auto device = std::make_unique<Device>();
+            device->fd = pipeFds[0];
+            device->path = path + "#" + std::to_string(chunk.id);
+            device->name = chunk.name;
+            device->classes = chunk.classes;
+            device->absX.minimum = chunk.absXMinimum;
+            device->absX.maximum = chunk.absXMaximum;
+            device->absY.minimum = chunk.absYMinimum;
+            device->absY.maximum = chunk.absYMaximum;
+            AddDevice(std::move(device));
+        }
+
+        if (!(0.f < speed))
+            speed = 1.f;
+        LogInfo("[+] Replaying input recording %s at %.2fx", path.data(), speed);
+        m_replayThread = std::make_unique<std::thread>(&ATouchEvent::ReplayWorker, this, speed);
 
         return true;
     }
-}
\ No newline at end of file
+
+    void ATouchEvent::ReplayWorker(float speed)
+    {
+        auto replayStart = std::chrono::steady_clock::now();
+        int64_t firstTimestampNanoseconds = -1;
+        size_t eventCount = 0;
+
+        // A reader closing its device leaves the pipe without a read end, the write fails with EPIPE
+        // instead of raising SIGPIPE for the whole process
+        sigset_t pipeSignal;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+        // The events of a report are written at once, as the kernel hands them to readers.
+        // Pipe writes up to PIPE_BUF are all or nothing, a reader never sees half a report.
+        static_assert(MaxPacketEvents * sizeof(input_event) <= PIPE_BUF);
+        std::array<input_event, MaxPacketEvents> packet{};
+        size_t packetEventCount = 0;
+        uint32_t packetDeviceId = 0;
+        std::unique_lock lock(m_replayMutex);
+        const auto writePacket = [&]()
+        {
+            auto &replayFd = m_replayFds[packetDeviceId];
+            auto packetSize = packetEventCount * sizeof(input_event);
+
+            // A full pipe means the reader is behind, wait for it instead of losing events
+            while (-1 != replayFd && static_cast<ssize_t>(packetSize) != write(replayFd, packet.data(), packetSize))
+            {
+                if (EPIPE == errno)
+                {
+                    timespec noWait{};
+                    sigtimedwait(&pipeSignal, nullptr, &noWait);
+
+                    LogDebug("[-] Replayed device %u was closed by the reader, dropping it", packetDeviceId);
+                    close(replayFd);
+                    replayFd = -1;
+                    break;
+                }
+                if ((EAGAIN != errno && EINTR != errno) || m_replayCondition.wait_for(lock, std::chrono::milliseconds(1), [this]
+                                                                               { return m_replayStopping; }))
+                    break;
+            }
+            eventCount += packetEventCount;
+            packetEventCount = 0;
+        };
+
+        for (size_t offset = sizeof(RecordHeader); !m_replayStopping && offset + sizeof(RecordChunkType) <= m_replayData.size();)
+        {
+            RecordChunkType chunkType{};
+            memcpy(&chunkType, m_replayData.data() + offset, sizeof(chunkType));
+            offset += sizeof(chunkType);
+            if (RecordChunkDevice == chunkType)
+            {
+                offset += sizeof(RecordDeviceChunk);
+                continue;
+            }
+            if (RecordChunkEvent != chunkType || offset + sizeof(RecordEventChunk) > m_replayData.size())
+                break;
+
+            RecordEventChunk chunk{};
+            memcpy(&chunk, m_replayData.data() + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if (m_replayFds.size() <= chunk.id || -1 == m_replayFds[chunk.id])
+                continue;
+
+            // Another device's report is never held back by an unfinished one
+            if (0 < packetEventCount && packetDeviceId != chunk.id)
+                writePacket();
+
+            if (-1 == firstTimestampNanoseconds)
+                firstTimestampNanoseconds = chunk.timestampNanoseconds;
+            auto dueTime = replayStart + std::chrono::nanoseconds(static_cast<int64_t>((chunk.timestampNanoseconds - firstTimestampNanoseconds) / speed));
+            if (m_replayCondition.wait_until(lock, dueTime, [this]
+                                             { return m_replayStopping; }))
+                break;
+
+            // Restamped with the replay time so latency is measured as for live input
+            timespec currentTimeSpec{};
+            auto &event = packet[packetEventCount++];
+            clock_gettime(CLOCK_MONOTONIC, &currentTimeSpec);
+            event.input_event_sec = currentTimeSpec.tv_sec;
+            event.input_event_usec = currentTimeSpec.tv_nsec / 1000;
+            event.type = chunk.type;
+            event.code = chunk.code;
+            event.value = chunk.value;
+            packetDeviceId = chunk.id;
+            if ((EV_SYN == chunk.type && SYN_REPORT == chunk.code) || packet.size() == packetEventCount)
+                writePacket();
+        }
+        if (0 < packetEventCount && !m_replayStopping)
+            writePacket();
+        lock.unlock();
+
+        // The readers see end of file and close their devices
+        CloseReplayPipes();
+        LogInfo("[=] Input replay finished, %zu events", eventCount);
+    }
+
+    void ATouchEvent::CloseReplayPipes()
+    {
+        for (auto &replayFd : m_replayFds)
+        {
+            if (-1 != replayFd)
+                close(replayFd);
+            replayFd = -1;
+        }
+    }
+}
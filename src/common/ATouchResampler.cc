@@ -0,0 +1,61 @@
+#include "ATouchResampler.h"
+
+#include <algorithm>
+
+namespace android
+{
+    void ATouchResampler::AddSample(int64_t timestampNanoseconds, float x, float y)
+    {
+        // A sample of the same report replaces the newest one instead of making a zero delta
+        if (0 != m_sampleCount && timestampNanoseconds <= m_samples[m_sampleCount - 1].timestampNanoseconds)
+        {
+            m_samples[m_sampleCount - 1] = {m_samples[m_sampleCount - 1].timestampNanoseconds, x, y};
+            return;
+        }
+
+        if (m_samples.size() == m_sampleCount)
+        {
+            m_samples[0] = m_samples[1];
+            --m_sampleCount;
+        }
+        m_samples[m_sampleCount++] = {timestampNanoseconds, x, y};
+    }
+
+    void ATouchResampler::Reset()
+    {
+        m_sampleCount = 0;
+    }
+
+    bool ATouchResampler::Resample(int64_t targetNanoseconds, float *x, float *y) const
+    {
+        if (0 == m_sampleCount)
+            return false;
+
+        const auto &current = m_samples[m_sampleCount - 1];
+        *x = current.x;
+        *y = current.y;
+        if (2 > m_sampleCount)
+            return true;
+
+        const auto &previous = m_samples[0];
+        auto deltaMilliseconds = (current.timestampNanoseconds - previous.timestampNanoseconds) / 1000000.f;
+        if (m_options.minDeltaMilliseconds > deltaMilliseconds || m_options.maxDeltaMilliseconds < deltaMilliseconds)
+            return true;
+
+        auto sampleMilliseconds = (targetNanoseconds - previous.timestampNanoseconds) / 1000000.f - m_options.resampleLatencyMilliseconds;
+        if (0.f >= sampleMilliseconds)
+            return true; // Older than both samples, nothing to interpolate between
+        if (sampleMilliseconds > deltaMilliseconds)
+        {
+            // Half the sample interval bounds the extrapolation like Android does, a fast panel predicts less
+            auto maxPrediction = std::min(deltaMilliseconds / 2.f, m_options.maxPredictionMilliseconds);
+            sampleMilliseconds = std::min(sampleMilliseconds, deltaMilliseconds + maxPrediction);
+        }
+
+        auto alpha = sampleMilliseconds / deltaMilliseconds;
+        *x = previous.x + (current.x - previous.x) * alpha;
+        *y = previous.y + (current.y - previous.y) * alpha;
+
+        return true;
+    }
+}
@@ -0,0 +1,257 @@
+#include "ATracer.h"
+
+#include "Global.h"
+
+#ifdef AIMGUI_ENABLE_TRACING
+#include <android/trace.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char *name;
+        uint64_t beginNanoseconds;
+        uint64_t endNanoseconds;
+    };
+
+    // Sequence lock of one event: odd while its thread writes it, 2 * (write index + 1) once written
+    struct TraceSlot
+    {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> beginNanoseconds{0};
+        std::atomic<uint64_t> endNanoseconds{0};
+    };
+
+    // Written only by its own thread, readers copy the newest events without stopping it
+    struct ThreadBuffer
+    {
+        static constexpr size_t EventCount = 8192;
+
+        pid_t threadId = 0;
+        char threadName[16]{};
+        std::atomic<uint64_t> writeCount{0};
+        std::array<TraceSlot, EventCount> events{};
+    };
+
+    std::mutex g_threadBuffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> g_threadBuffers; // Kept after their thread exits so its events can still be exported
+    std::atomic<bool> g_recording{false};
+    std::atomic<uint64_t> g_recordingStartNanoseconds{0};
+    thread_local ThreadBuffer *t_threadBuffer = nullptr;
+
+    uint64_t NowNanoseconds()
+    {
+        timespec currentTimeSpec{};
+        clock_gettime(CLOCK_MONOTONIC, &currentTimeSpec);
+
+        return static_cast<uint64_t>(currentTimeSpec.tv_sec) * 1000000000ull + currentTimeSpec.tv_nsec;
+    }
+
+    ThreadBuffer *GetThreadBuffer()
+    {
+        if (nullptr != t_threadBuffer)
+            return t_threadBuffer;
+
+        auto threadBuffer = std::make_unique<ThreadBuffer>();
+        threadBuffer->threadId = gettid();
+        prctl(PR_GET_NAME, threadBuffer->threadName);
+
+        std::lock_guard lock(g_threadBuffersMutex);
+        t_threadBuffer = threadBuffer.get();
+        g_threadBuffers.push_back(std::move(threadBuffer));
+
+        return t_threadBuffer;
+    }
+
+    // Copy the event written at writeIndex, false when it is being overwritten
+    bool ReadTraceSlot(const TraceSlot &slot, uint64_t writeIndex, TraceEvent *event)
+    {
+        auto sequence = 2 * (writeIndex + 1);
+        if (sequence != slot.sequence.load(std::memory_order_acquire))
+            return false;
+
+        event->name = slot.name.load(std::memory_order_relaxed);
+        event->beginNanoseconds = slot.beginNanoseconds.load(std::memory_order_relaxed);
+        event->endNanoseconds = slot.endNanoseconds.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return sequence == slot.sequence.load(std::memory_order_relaxed);
+    }
+
+    void WriteJsonString(FILE *file, const char *string)
+    {
+        fputc('"', file);
+        for (auto character = string; nullptr != character && '\0' != *character; ++character)
+        {
+            auto value = static_cast<unsigned char>(*character);
+            if ('"' == value || '\\' == value)
+                fprintf(file, "\\%c", value);
+            else if (0x20 > value)
+                fprintf(file, "\\u%04x", value);
+            else
+                fputc(value, file);
+        }
+        fputc('"', file);
+    }
+
+    // ATrace is only exported by libandroid from API 23 on
+    bool IsAtraceEnabled()
+    {
+#if __ANDROID_API__ >= 23
+        return ATrace_isEnabled();
+#else
+        return false;
+#endif
+    }
+
+    void BeginAtraceSection(const char *name)
+    {
+#if __ANDROID_API__ >= 23
+        ATrace_beginSection(name);
+#endif
+    }
+
+    void EndAtraceSection()
+    {
+#if __ANDROID_API__ >= 23
+        ATrace_endSection();
+#endif
+    }
+}
+
+namespace android
+{
+    void ATracer::Start()
+    {
+        g_recordingStartNanoseconds.store(NowNanoseconds(), std::memory_order_relaxed);
+        g_recording.store(true, std::memory_order_release);
+    }
+
+    void ATracer::Stop()
+    {
+        g_recording.store(false, std::memory_order_release);
+    }
+
+    bool ATracer::IsRecording()
+    {
+        return g_recording.load(std::memory_order_acquire);
+    }
+
+    bool ATracer::WriteChromeJson(const char *path)
+    {
+        auto file = fopen(path, "w");
+        if (nullptr == file)
+        {
+            LogDebug("[-] Tracer can not open %s", path);
+            return false;
+        }
+
+        auto recordingStart = g_recordingStartNanoseconds.load(std::memory_order_relaxed);
+        auto processId = getpid();
+        size_t eventCount = 0;
+        bool firstEvent = true;
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        {
+            std::lock_guard lock(g_threadBuffersMutex);
+
+            for (const auto &threadBuffer : g_threadBuffers)
+            {
+                fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                        firstEvent ? "" : ",", processId, threadBuffer->threadId);
+                WriteJsonString(file, threadBuffer->threadName);
+                fprintf(file, "}}");
+                firstEvent = false;
+
+                auto writeCount = threadBuffer->writeCount.load(std::memory_order_acquire);
+                auto count = std::min<uint64_t>(writeCount, ThreadBuffer::EventCount);
+                for (auto i = writeCount - count; i < writeCount; ++i)
+                {
+                    // The owning thread may already be reusing the slot for a newer event
+                    TraceEvent event{};
+                    if (!ReadTraceSlot(threadBuffer->events[i % ThreadBuffer::EventCount], i, &event) || event.beginNanoseconds < recordingStart)
+                        continue;
+
+                    fprintf(file, ",\n{\"name\":");
+                    WriteJsonString(file, event.name);
+                    fprintf(file, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                            processId, threadBuffer->threadId,
+                            event.beginNanoseconds / 1000.0, (event.endNanoseconds - event.beginNanoseconds) / 1000.0);
+                    ++eventCount;
+                }
+            }
+        }
+        fprintf(file, "\n]}\n");
+
+        auto written = 0 == ferror(file);
+        fclose(file);
+        LogInfo("[=] Tracer wrote %zu events to %s", eventCount, path);
+
+        return written;
+    }
+
+    ATracer::Scope::Scope(const char *name)
+        : m_name(name), m_beginNanoseconds(0), m_recording(g_recording.load(std::memory_order_relaxed)), m_atrace(IsAtraceEnabled())
+    {
+        if (m_atrace)
+            BeginAtraceSection(name);
+        if (m_recording)
+            m_beginNanoseconds = NowNanoseconds();
+    }
+
+    ATracer::Scope::~Scope()
+    {
+        if (m_recording)
+        {
+            auto threadBuffer = GetThreadBuffer();
+            auto writeIndex = threadBuffer->writeCount.load(std::memory_order_relaxed);
+            auto &slot = threadBuffer->events[writeIndex % ThreadBuffer::EventCount];
+            auto endNanoseconds = NowNanoseconds();
+
+            slot.sequence.store(2 * writeIndex + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.name.store(m_name, std::memory_order_relaxed);
+            slot.beginNanoseconds.store(m_beginNanoseconds, std::memory_order_relaxed);
+            slot.endNanoseconds.store(endNanoseconds, std::memory_order_relaxed);
+            slot.sequence.store(2 * (writeIndex + 1), std::memory_order_release);
+            threadBuffer->writeCount.store(writeIndex + 1, std::memory_order_release);
+        }
+        if (m_atrace)
+            EndAtraceSection();
+    }
+}
+#else
+namespace android
+{
+    void ATracer::Start()
+    {
+        LogDebug("[-] Tracer is not built, enable ANDROID_SURFACE_IMGUI_ENABLE_TRACING");
+    }
+
+    void ATracer::Stop()
+    {
+    }
+
+    bool ATracer::IsRecording()
+    {
+        return false;
+    }
+
+    bool ATracer::WriteChromeJson(const char *)
+    {
+        return false;
+    }
+}
+#endif
@@ -22,8 +22,7 @@ void Gui()
         {
             while (state)
             {
-                imgui.ProcessInputEvent();
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
+                imgui.WaitInputEvent();
             }
         });
 
@@ -72,6 +71,7 @@ void Gui()
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
+    imgui.InterruptInputEvent();
     if (processInputEventThread.joinable())
         processInputEventThread.join();
 }
@@ -0,0 +1,109 @@
+#ifndef HOST_TEST_INPUT_RECORDING_H // !HOST_TEST_INPUT_RECORDING_H
+#define HOST_TEST_INPUT_RECORDING_H
+
+#include "ATouchEvent.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Writes synthetic recordings for ATouchEvent replays, the layout mirrors the one in ATouchEvent.cc.
+class InputRecordingWriter
+{
+public:
+    explicit InputRecordingWriter(const std::string &path)
+        : m_file(fopen(path.data(), "wb"))
+    {
+        RecordHeader header{{'A', 'I', 'M', 'G', 'U', 'I', 'E', 'V'}, 1};
+
+        if (nullptr != m_file)
+            fwrite(&header, sizeof(header), 1, m_file);
+    }
+    ~InputRecordingWriter()
+    {
+        if (nullptr != m_file)
+            fclose(m_file);
+    }
+
+    explicit operator bool() const
+    {
+        return nullptr != m_file;
+    }
+
+    void AddTouchScreen(uint32_t id, int32_t width, int32_t height)
+    {
+        RecordDeviceChunk chunk{id, android::ATouchEvent::DeviceClassTouch, 0, width - 1, 0, height - 1, "Recorded touch screen"};
+
+        WriteChunk(ChunkDevice, chunk);
+    }
+
+    void AddEvent(uint32_t id, uint16_t type, uint16_t code, int32_t value, int64_t timestampNanoseconds)
+    {
+        RecordEventChunk chunk{id, type, code, value, timestampNanoseconds};
+
+        WriteChunk(ChunkEvent, chunk);
+    }
+
+    // One report of the first finger, down and up included
+    void AddTouchReport(uint32_t id, int x, int y, int64_t timestampNanoseconds, bool down = false, bool up = false)
+    {
+        if (down)
+            AddEvent(id, EV_ABS, ABS_MT_TRACKING_ID, 1, timestampNanoseconds);
+        if (up)
+            AddEvent(id, EV_ABS, ABS_MT_TRACKING_ID, -1, timestampNanoseconds);
+        else
+        {
+            AddEvent(id, EV_ABS, ABS_MT_POSITION_X, x, timestampNanoseconds);
+            AddEvent(id, EV_ABS, ABS_MT_POSITION_Y, y, timestampNanoseconds);
+        }
+        if (down || up)
+            AddEvent(id, EV_KEY, BTN_TOUCH, down ? 1 : 0, timestampNanoseconds);
+        AddEvent(id, EV_SYN, SYN_REPORT, 0, timestampNanoseconds);
+    }
+
+private:
+    enum ChunkType : uint32_t
+    {
+        ChunkDevice = 1,
+        ChunkEvent = 2,
+    };
+
+    struct RecordHeader
+    {
+        char magic[8];
+        uint32_t version;
+    };
+
+    struct RecordDeviceChunk
+    {
+        uint32_t id;
+        uint32_t classes;
+        int32_t absXMinimum, absXMaximum;
+        int32_t absYMinimum, absYMaximum;
+        char name[128];
+    };
+
+    struct RecordEventChunk
+    {
+        uint32_t id;
+        uint16_t type;
+        uint16_t code;
+        int32_t value;
+        int64_t timestampNanoseconds;
+    };
+
+    template <typename chunk_t>
+    void WriteChunk(ChunkType type, const chunk_t &chunk)
+    {
+        if (nullptr == m_file)
+            return;
+
+        fwrite(&type, sizeof(type), 1, m_file);
+        fwrite(&chunk, sizeof(chunk), 1, m_file);
+    }
+
+private:
+    FILE *m_file;
+};
+
+#endif // !HOST_TEST_INPUT_RECORDING_H
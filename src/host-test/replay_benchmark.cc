@@ -0,0 +1,82 @@
+#include "ATouchEvent.h"
+#include "InputRecording.h"
+
+#include <sys/syscall.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Replays a synthetic recording through the pipes of ATouchEvent as fast as the reader keeps up,
+// then reports assembled events per second and the syscalls the reader made per packet.
+
+namespace
+{
+    std::atomic<size_t> g_readCalls = 0;
+    std::atomic<size_t> g_waitCalls = 0;
+}
+
+// Every read and epoll wait of the input code goes through here, the replay thread only writes
+extern "C" ssize_t read(int fd, void *buffer, size_t size)
+{
+    ++g_readCalls;
+
+    return syscall(SYS_read, fd, buffer, size);
+}
+
+extern "C" int epoll_wait(int epollFd, epoll_event *events, int maxEvents, int timeout)
+{
+    ++g_waitCalls;
+
+    return static_cast<int>(syscall(SYS_epoll_pwait, epollFd, events, maxEvents, timeout, nullptr, _NSIG / 8));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t packetCount = 1 < argc ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    auto path = std::string(2 < argc ? argv[2] : "replay_benchmark.bin");
+
+    // A finger dragged across the panel at 120Hz, three input_event per move report
+    {
+        InputRecordingWriter writer(path);
+        if (!writer)
+        {
+            fprintf(stderr, "[-] Could not write %s\n", path.data());
+            return EXIT_FAILURE;
+        }
+
+        int64_t timestampNanoseconds = 1000000000;
+        writer.AddTouchScreen(0, 1080, 2400);
+        writer.AddTouchReport(0, 0, 1200, timestampNanoseconds, true);
+        for (size_t i = 1; i <= packetCount; ++i)
+            writer.AddTouchReport(0, static_cast<int>(i % 1080), 1200, timestampNanoseconds += 8333333);
+        writer.AddTouchReport(0, 0, 0, timestampNanoseconds += 8333333, false, true);
+    }
+
+    // Fast enough that every event is due at once, the pipe throttles the replay to the reader
+    android::ATouchEvent touchEvent(path, 1e9f);
+    android::ATouchEvent::TouchEvent event{};
+    size_t touchEventCount = 0;
+    size_t expectedCount = packetCount + 2;
+
+    g_readCalls = 0;
+    g_waitCalls = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    while (touchEventCount < expectedCount && touchEvent.WaitTouchEvent(&event, 1000))
+        ++touchEventCount;
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    remove(path.data());
+
+    auto reportCount = static_cast<double>(packetCount + 2);
+    printf("[=] %zu of %zu events in %.3fs, %.0f events/s\n", touchEventCount, expectedCount, elapsed, touchEventCount / elapsed);
+    printf("[=] %.3f read and %.3f epoll_wait syscalls per packet, one read per input_event would be %.3f\n",
+           g_readCalls / reportCount,
+           g_waitCalls / reportCount,
+           static_cast<double>(packetCount * 3 + 8) / reportCount);
+    printf("[=] %llu events dropped\n", static_cast<unsigned long long>(touchEvent.GetDroppedCount()));
+
+    return expectedCount == touchEventCount && 0 == touchEvent.GetDroppedCount() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,172 @@
+#include "AInputQueue.h"
+#include "ATouchEvent.h"
+#include "ATouchResampler.h"
+#include "InputRecording.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+// A headless frame loop fed by a replayed drag: the input thread pushes replayed events into
+// AInputQueue and a 60Hz loop drains it and resamples the drag the way AImGui does, without a surface.
+
+namespace
+{
+    constexpr int64_t ReportIntervalNanoseconds = 8333333;  // 120Hz touch panel
+    constexpr int64_t FrameIntervalNanoseconds = 16666667;  // 60Hz display
+    constexpr int64_t ResampleLatencyNanoseconds = 5000000; // ATouchResampler::Options default
+    constexpr int ReportCount = 240;
+    constexpr int UnitsPerReport = 4;
+
+    int64_t GetMonotonicNanoseconds()
+    {
+        timespec currentTimeSpec{};
+
+        clock_gettime(CLOCK_MONOTONIC, &currentTimeSpec);
+        return static_cast<int64_t>(currentTimeSpec.tv_sec) * 1000000000ll + currentTimeSpec.tv_nsec;
+    }
+
+    bool Expect(bool condition, const char *message)
+    {
+        if (!condition)
+            fprintf(stderr, "[-] %s\n", message);
+
+        return condition;
+    }
+
+    // A recording naming an absurd device id must be refused, not grow the replay tables
+    bool CheckCorruptRecording(const std::string &path)
+    {
+        {
+            InputRecordingWriter writer(path);
+            writer.AddTouchScreen(1u << 30, 1080, 2400);
+            writer.AddTouchReport(1u << 30, 10, 10, 1000000000, true);
+        }
+
+        android::ATouchEvent touchEvent(path, 1.f);
+        android::ATouchEvent::TouchEvent event{};
+        bool result = Expect(!touchEvent.WaitTouchEvent(&event, 200), "A recording with an out of range device id was replayed");
+        remove(path.data());
+
+        return result;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    auto path = std::string(1 < argc ? argv[1] : "replay_frame_loop.bin");
+    bool passed = CheckCorruptRecording(path);
+
+    // A finger dragged right at a constant speed for two seconds
+    {
+        InputRecordingWriter writer(path);
+        if (!writer)
+        {
+            fprintf(stderr, "[-] Could not write %s\n", path.data());
+            return EXIT_FAILURE;
+        }
+
+        int64_t timestampNanoseconds = 1000000000;
+        writer.AddTouchScreen(0, 1080, 2400);
+        writer.AddTouchReport(0, 0, 1200, timestampNanoseconds, true);
+        for (int i = 1; i <= ReportCount; ++i)
+            writer.AddTouchReport(0, i * UnitsPerReport, 1200, timestampNanoseconds += ReportIntervalNanoseconds);
+        writer.AddTouchReport(0, 0, 0, timestampNanoseconds += ReportIntervalNanoseconds, false, true);
+    }
+
+    android::ATouchEvent touchEvent(path, 1.f);
+    android::AInputQueue inputQueue;
+    std::atomic<bool> inputStopping = false;
+    std::thread inputThread([&]
+                            {
+                                android::ATouchEvent::TouchEvent event{};
+
+                                while (!inputStopping)
+                                {
+                                    if (touchEvent.WaitTouchEvent(&event, 100))
+                                        inputQueue.Push(event);
+                                } });
+
+    std::array<android::AInputQueue::Entry, android::AInputQueue::Capacity> entries;
+    android::ATouchResampler touchResampler;
+    android::ATouchEvent::TouchEvent touchDown{};
+    bool pointerDown = false, touchUp = false;
+    size_t frameCount = 0, dragFrameCount = 0, entryCount = 0, eventCount = 0;
+    double latencySum = 0.0, latencyMaximum = 0.0, resampledErrorSum = 0.0, rawErrorSum = 0.0;
+    float newestX = 0.f;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    auto nextFrame = std::chrono::steady_clock::now();
+    while (!touchUp && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_until(nextFrame += std::chrono::nanoseconds(FrameIntervalNanoseconds));
+        auto frameNanoseconds = GetMonotonicNanoseconds();
+        auto drainedCount = inputQueue.Drain(entries.data(), entries.size());
+        bool dragMoved = false;
+
+        ++frameCount;
+        entryCount += drainedCount;
+        for (size_t i = 0; i < drainedCount; ++i)
+        {
+            const auto &entry = entries[i];
+            const auto &event = entry.event;
+            auto latency = (frameNanoseconds - entry.oldestNanoseconds) / 1e6;
+
+            eventCount += entry.moveCount ? entry.moveCount : 1;
+            latencySum += latency;
+            latencyMaximum = std::max(latencyMaximum, latency);
+            if (android::ATouchEvent::EventType::TouchDown == event.type)
+            {
+                touchDown = event;
+                pointerDown = true;
+                touchResampler.Reset();
+                touchResampler.AddSample(event.timestampNanoseconds, event.x, event.y);
+            }
+            else if (android::ATouchEvent::EventType::TouchUp == event.type)
+                touchUp = true;
+            else if (android::ATouchEvent::EventType::Move == event.type && pointerDown)
+            {
+                if (1 < entry.moveCount)
+                    touchResampler.AddSample(entry.previousMove.timestampNanoseconds, entry.previousMove.x, entry.previousMove.y);
+                touchResampler.AddSample(event.timestampNanoseconds, event.x, event.y);
+                newestX = event.x;
+                dragMoved = true;
+            }
+        }
+
+        if (!dragMoved || touchUp)
+            continue;
+
+        // Where the finger is when the frame reaches the screen, from the recorded speed
+        float x = 0.f, y = 0.f;
+        auto targetNanoseconds = frameNanoseconds + FrameIntervalNanoseconds;
+        auto sampleNanoseconds = targetNanoseconds - ResampleLatencyNanoseconds;
+        auto expectedX = touchDown.x + static_cast<double>(sampleNanoseconds - touchDown.timestampNanoseconds) * UnitsPerReport / ReportIntervalNanoseconds;
+        touchResampler.Resample(targetNanoseconds, &x, &y);
+
+        ++dragFrameCount;
+        resampledErrorSum += std::abs(x - expectedX);
+        rawErrorSum += std::abs(newestX - expectedX);
+    }
+
+    inputStopping = true;
+    inputThread.join();
+    remove(path.data());
+
+    printf("[=] %zu frames, %zu events, %.2f events per frame\n", frameCount, eventCount, static_cast<double>(eventCount) / std::max<size_t>(1, frameCount));
+    printf("[=] Input latency at frame start %.2fms average %.2fms maximum\n", latencySum / std::max<size_t>(1, entryCount), latencyMaximum);
+    if (0 < dragFrameCount)
+        printf("[=] Drag error at present time %.2f units resampled, %.2f units with the newest report\n", resampledErrorSum / dragFrameCount, rawErrorSum / dragFrameCount);
+
+    passed &= Expect(touchUp, "The replayed drag did not finish");
+    passed &= Expect(ReportCount + 2 == static_cast<int>(eventCount), "Replayed events were lost");
+    passed &= Expect(0 == touchEvent.GetDroppedCount() && 0 == inputQueue.GetDroppedCount(), "Replayed events were dropped");
+    passed &= Expect(resampledErrorSum < rawErrorSum, "Resampling did not bring the drag closer to the finger");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+#include <android/log.h>
+#include <sys/system_properties.h>
+
+#include <cstdarg>
+#include <cstdio>
+
+extern "C" int __android_log_print(int priority, const char *tag, const char *formatter, ...)
+{
+    va_list arguments;
+
+    if (ANDROID_LOG_DEBUG == priority)
+        return 0;
+
+    va_start(arguments, formatter);
+    fprintf(stderr, "%s: ", tag);
+    vfprintf(stderr, formatter, arguments);
+    fputc('\n', stderr);
+    va_end(arguments);
+
+    return 0;
+}
+
+extern "C" int __system_property_get(const char *, char *value)
+{
+    value[0] = 0;
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+#ifndef HOST_TEST_ANDROID_KEYCODES_H // !HOST_TEST_ANDROID_KEYCODES_H
+#define HOST_TEST_ANDROID_KEYCODES_H
+
+// Host replacement of the NDK header. Only the key codes the input code maps to are declared,
+// their values are distinct but do not follow the NDK.
+
+enum
+{
+    AKEYCODE_UNKNOWN = 0,
+    AKEYCODE_ESCAPE = 1,
+    AKEYCODE_1 = 2,
+    AKEYCODE_2 = 3,
+    AKEYCODE_3 = 4,
+    AKEYCODE_4 = 5,
+    AKEYCODE_5 = 6,
+    AKEYCODE_6 = 7,
+    AKEYCODE_7 = 8,
+    AKEYCODE_8 = 9,
+    AKEYCODE_9 = 10,
+    AKEYCODE_0 = 11,
+    AKEYCODE_MINUS = 12,
+    AKEYCODE_EQUALS = 13,
+    AKEYCODE_DEL = 14,
+    AKEYCODE_TAB = 15,
+    AKEYCODE_Q = 16,
+    AKEYCODE_W = 17,
+    AKEYCODE_E = 18,
+    AKEYCODE_R = 19,
+    AKEYCODE_T = 20,
+    AKEYCODE_Y = 21,
+    AKEYCODE_U = 22,
+    AKEYCODE_I = 23,
+    AKEYCODE_O = 24,
+    AKEYCODE_P = 25,
+    AKEYCODE_LEFT_BRACKET = 26,
+    AKEYCODE_RIGHT_BRACKET = 27,
+    AKEYCODE_ENTER = 28,
+    AKEYCODE_CTRL_LEFT = 29,
+    AKEYCODE_A = 30,
+    AKEYCODE_S = 31,
+    AKEYCODE_D = 32,
+    AKEYCODE_F = 33,
+    AKEYCODE_G = 34,
+    AKEYCODE_H = 35,
+    AKEYCODE_J = 36,
+    AKEYCODE_K = 37,
+    AKEYCODE_L = 38,
+    AKEYCODE_SEMICOLON = 39,
+    AKEYCODE_APOSTROPHE = 40,
+    AKEYCODE_GRAVE = 41,
+    AKEYCODE_SHIFT_LEFT = 42,
+    AKEYCODE_BACKSLASH = 43,
+    AKEYCODE_Z = 44,
+    AKEYCODE_X = 45,
+    AKEYCODE_C = 46,
+    AKEYCODE_V = 47,
+    AKEYCODE_B = 48,
+    AKEYCODE_N = 49,
+    AKEYCODE_M = 50,
+    AKEYCODE_COMMA = 51,
+    AKEYCODE_PERIOD = 52,
+    AKEYCODE_SLASH = 53,
+    AKEYCODE_SHIFT_RIGHT = 54,
+    AKEYCODE_NUMPAD_MULTIPLY = 55,
+    AKEYCODE_ALT_LEFT = 56,
+    AKEYCODE_SPACE = 57,
+    AKEYCODE_CAPS_LOCK = 58,
+    AKEYCODE_F1 = 59,
+    AKEYCODE_F2 = 60,
+    AKEYCODE_F3 = 61,
+    AKEYCODE_F4 = 62,
+    AKEYCODE_F5 = 63,
+    AKEYCODE_F6 = 64,
+    AKEYCODE_F7 = 65,
+    AKEYCODE_F8 = 66,
+    AKEYCODE_F9 = 67,
+    AKEYCODE_F10 = 68,
+    AKEYCODE_NUM_LOCK = 69,
+    AKEYCODE_SCROLL_LOCK = 70,
+    AKEYCODE_NUMPAD_7 = 71,
+    AKEYCODE_NUMPAD_8 = 72,
+    AKEYCODE_NUMPAD_9 = 73,
+    AKEYCODE_NUMPAD_SUBTRACT = 74,
+    AKEYCODE_NUMPAD_4 = 75,
+    AKEYCODE_NUMPAD_5 = 76,
+    AKEYCODE_NUMPAD_6 = 77,
+    AKEYCODE_NUMPAD_ADD = 78,
+    AKEYCODE_NUMPAD_1 = 79,
+    AKEYCODE_NUMPAD_2 = 80,
+    AKEYCODE_NUMPAD_3 = 81,
+    AKEYCODE_NUMPAD_0 = 82,
+    AKEYCODE_NUMPAD_DOT = 83,
+    AKEYCODE_ZENKAKU_HANKAKU = 84,
+    AKEYCODE_F11 = 85,
+    AKEYCODE_F12 = 86,
+    AKEYCODE_RO = 87,
+    AKEYCODE_HENKAN = 88,
+    AKEYCODE_KATAKANA_HIRAGANA = 89,
+    AKEYCODE_MUHENKAN = 90,
+    AKEYCODE_NUMPAD_COMMA = 91,
+    AKEYCODE_NUMPAD_ENTER = 92,
+    AKEYCODE_CTRL_RIGHT = 93,
+    AKEYCODE_NUMPAD_DIVIDE = 94,
+    AKEYCODE_SYSRQ = 95,
+    AKEYCODE_ALT_RIGHT = 96,
+    AKEYCODE_MOVE_HOME = 97,
+    AKEYCODE_DPAD_UP = 98,
+    AKEYCODE_PAGE_UP = 99,
+    AKEYCODE_DPAD_LEFT = 100,
+    AKEYCODE_DPAD_RIGHT = 101,
+    AKEYCODE_MOVE_END = 102,
+    AKEYCODE_DPAD_DOWN = 103,
+    AKEYCODE_PAGE_DOWN = 104,
+    AKEYCODE_INSERT = 105,
+    AKEYCODE_FORWARD_DEL = 106,
+    AKEYCODE_VOLUME_MUTE = 107,
+    AKEYCODE_VOLUME_DOWN = 108,
+    AKEYCODE_VOLUME_UP = 109,
+    AKEYCODE_POWER = 110,
+    AKEYCODE_NUMPAD_EQUALS = 111,
+    AKEYCODE_BREAK = 112,
+    AKEYCODE_KANA = 113,
+    AKEYCODE_EISU = 114,
+    AKEYCODE_YEN = 115,
+    AKEYCODE_META_LEFT = 116,
+    AKEYCODE_META_RIGHT = 117,
+    AKEYCODE_MENU = 118,
+    AKEYCODE_MEDIA_STOP = 119,
+    AKEYCODE_COPY = 120,
+    AKEYCODE_PASTE = 121,
+    AKEYCODE_CUT = 122,
+    AKEYCODE_CALCULATOR = 123,
+    AKEYCODE_SLEEP = 124,
+    AKEYCODE_WAKEUP = 125,
+    AKEYCODE_EXPLORER = 126,
+    AKEYCODE_ENVELOPE = 127,
+    AKEYCODE_BOOKMARK = 128,
+    AKEYCODE_BACK = 129,
+    AKEYCODE_FORWARD = 130,
+    AKEYCODE_MEDIA_CLOSE = 131,
+    AKEYCODE_MEDIA_EJECT = 132,
+    AKEYCODE_MEDIA_NEXT = 133,
+    AKEYCODE_MEDIA_PLAY_PAUSE = 134,
+    AKEYCODE_MEDIA_PREVIOUS = 135,
+    AKEYCODE_MEDIA_RECORD = 136,
+    AKEYCODE_MEDIA_REWIND = 137,
+    AKEYCODE_CALL = 138,
+    AKEYCODE_MUSIC = 139,
+    AKEYCODE_HOME = 140,
+    AKEYCODE_REFRESH = 141,
+    AKEYCODE_NUMPAD_LEFT_PAREN = 142,
+    AKEYCODE_NUMPAD_RIGHT_PAREN = 143,
+    AKEYCODE_MEDIA_PLAY = 144,
+    AKEYCODE_MEDIA_PAUSE = 145,
+    AKEYCODE_NOTIFICATION = 146,
+    AKEYCODE_MEDIA_FAST_FORWARD = 147,
+    AKEYCODE_CAMERA = 148,
+    AKEYCODE_SEARCH = 149,
+    AKEYCODE_BRIGHTNESS_DOWN = 150,
+    AKEYCODE_BRIGHTNESS_UP = 151,
+    AKEYCODE_HEADSETHOOK = 152,
+};
+
+#endif // !HOST_TEST_ANDROID_KEYCODES_H
@@ -0,0 +1,15 @@
+#ifndef HOST_TEST_ANDROID_LOG_H // !HOST_TEST_ANDROID_LOG_H
+#define HOST_TEST_ANDROID_LOG_H
+
+// Host replacement of the NDK header, the messages go to stderr.
+
+enum
+{
+    ANDROID_LOG_DEBUG = 3,
+    ANDROID_LOG_INFO = 4,
+    ANDROID_LOG_ERROR = 6,
+};
+
+extern "C" int __android_log_print(int priority, const char *tag, const char *formatter, ...);
+
+#endif // !HOST_TEST_ANDROID_LOG_H
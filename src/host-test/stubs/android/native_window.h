@@ -0,0 +1,17 @@
+#ifndef HOST_TEST_ANDROID_NATIVE_WINDOW_H // !HOST_TEST_ANDROID_NATIVE_WINDOW_H
+#define HOST_TEST_ANDROID_NATIVE_WINDOW_H
+
+// Host replacement of the NDK header, declarations only since the host tests never create a window.
+
+#include <cstdint>
+
+typedef struct ANativeWindow ANativeWindow;
+
+extern "C" void ANativeWindow_acquire(ANativeWindow *window);
+extern "C" void ANativeWindow_release(ANativeWindow *window);
+extern "C" int32_t ANativeWindow_getWidth(ANativeWindow *window);
+extern "C" int32_t ANativeWindow_getHeight(ANativeWindow *window);
+extern "C" int32_t ANativeWindow_setBuffersGeometry(ANativeWindow *window, int32_t width, int32_t height, int32_t format);
+extern "C" int32_t ANativeWindow_getFormat(ANativeWindow *window);
+
+#endif // !HOST_TEST_ANDROID_NATIVE_WINDOW_H
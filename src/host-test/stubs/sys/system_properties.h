@@ -0,0 +1,8 @@
+#ifndef HOST_TEST_SYS_SYSTEM_PROPERTIES_H // !HOST_TEST_SYS_SYSTEM_PROPERTIES_H
+#define HOST_TEST_SYS_SYSTEM_PROPERTIES_H
+
+// Host replacement of the bionic header, every property reads as empty.
+
+extern "C" int __system_property_get(const char *name, char *value);
+
+#endif // !HOST_TEST_SYS_SYSTEM_PROPERTIES_H
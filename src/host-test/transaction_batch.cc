@@ -0,0 +1,163 @@
+#include "ANativeWindowCreator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <string_view>
+#include <utility>
+
+// Counts the libgui calls a frame of surface operations turns into, every symbol resolves to its own counting stub.
+
+size_t android::anative_window_creator::detail::compat::SystemVersion = 14;
+
+namespace
+{
+    using namespace android::anative_window_creator::detail;
+
+    constexpr size_t MaxStubCount = 256;
+
+    std::array<const char *, MaxStubCount> g_stubSymbols{};
+    std::array<std::atomic<size_t>, MaxStubCount> g_stubCalls{};
+    size_t g_stubCount = 0;
+
+    template <size_t index>
+    void *Stub()
+    {
+        ++g_stubCalls[index];
+
+        return nullptr;
+    }
+
+    template <size_t... indices>
+    constexpr auto MakeStubs(std::index_sequence<indices...>)
+    {
+        return std::array<void *(*)(), sizeof...(indices)>{&Stub<indices>...};
+    }
+
+    constexpr auto g_stubs = MakeStubs(std::make_index_sequence<MaxStubCount>{});
+
+    void *OpenLibrary(const char *, int)
+    {
+        static char handle;
+
+        return &handle;
+    }
+
+    void *ResolveSymbol(void *, const char *symbol)
+    {
+        if (MaxStubCount == g_stubCount)
+            return nullptr;
+
+        g_stubSymbols[g_stubCount] = symbol;
+        return reinterpret_cast<void *>(g_stubs[g_stubCount++]);
+    }
+
+    int CloseLibrary(void *)
+    {
+        return 0;
+    }
+
+    size_t GetCallCount(std::string_view symbolPart)
+    {
+        size_t result = 0;
+
+        for (size_t i = 0; i < g_stubCount; ++i)
+        {
+            if (std::string_view{g_stubSymbols[i]}.find(symbolPart) != std::string_view::npos)
+                result += g_stubCalls[i];
+        }
+
+        return result;
+    }
+
+    void ResetCallCounts()
+    {
+        for (auto &calls : g_stubCalls)
+            calls = 0;
+    }
+
+    // Every Apply and every closed global transaction is one binder call to SurfaceFlinger
+    size_t GetBinderCallCount()
+    {
+        return GetCallCount("11Transaction5apply") + GetCallCount("22closeGlobalTransaction");
+    }
+
+    void IssueFrame(compat::SurfaceComposerClient &composer, compat::SurfaceControl &first, compat::SurfaceControl &second)
+    {
+        composer.ResizeSurface(first, 640, 480);
+        composer.ResizeSurface(second, 320, 240);
+        composer.SetSurfaceVisible(first, false);
+        composer.SetSurfaceVisible(second, true);
+
+        // The legacy composer has no transaction object to move a layer with
+        if (9 <= compat::SystemVersion)
+        {
+            composer.MoveSurface(first, 10.f, 20.f);
+            composer.MoveSurface(second, 30.f, 40.f);
+        }
+    }
+
+    bool Expect(bool condition, const char *message)
+    {
+        if (!condition)
+            fprintf(stderr, "[-] %s\n", message);
+
+        return condition;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (1 < argc)
+        compat::SystemVersion = std::strtoul(argv[1], nullptr, 10);
+
+    android::ANativeWindowCreator::SetupCustomApiResolver({OpenLibrary, ResolveSymbol, CloseLibrary});
+
+    auto &composer = android::ANativeWindowCreator::GetComposerInstance();
+    char firstSurface, secondSurface;
+    compat::SurfaceControl first{&firstSurface}, second{&secondSurface};
+    bool passed = true;
+
+    ResetCallCounts();
+    IssueFrame(composer, first, second);
+    auto unbatchedCalls = GetBinderCallCount();
+
+    ResetCallCounts();
+    composer.BeginTransactionBatch();
+    IssueFrame(composer, first, second);
+    auto pendingCalls = GetBinderCallCount();
+    composer.ApplyTransactionBatch();
+    auto batchedCalls = GetBinderCallCount();
+
+    printf("[=] Android %zu: %zu binder calls per frame unbatched, %zu batched\n", compat::SystemVersion, unbatchedCalls, batchedCalls);
+    passed &= Expect(0 == pendingCalls, "The batch reached SurfaceFlinger before it was applied");
+    passed &= Expect(1 == batchedCalls, "The batch was not applied in a single call");
+    passed &= Expect(batchedCalls < unbatchedCalls, "Batching did not reduce the binder calls");
+
+    if (8 >= compat::SystemVersion)
+    {
+        passed &= Expect(2 == GetCallCount("14SurfaceControl7setSize"), "The recorded resizes were not replayed");
+        passed &= Expect(1 == GetCallCount("14SurfaceControl4show") && 1 == GetCallCount("14SurfaceControl4hide"), "The recorded visibility changes were not replayed");
+
+        // A destroyed surface must not be touched by the replay
+        ResetCallCounts();
+        composer.BeginTransactionBatch();
+        composer.SetSurfaceVisible(first, true);
+        composer.DiscardGlobalOperations(first);
+        composer.ApplyTransactionBatch();
+        passed &= Expect(0 == GetCallCount("14SurfaceControl4show") && 0 == GetBinderCallCount(), "A discarded operation was replayed");
+    }
+
+    // An open batch must not hold anything another thread's surface operations wait for
+    ResetCallCounts();
+    composer.BeginTransactionBatch();
+    composer.SetSurfaceVisible(first, true);
+    auto otherThread = std::async(std::launch::async, [&composer, &second]
+                                  { composer.SetSurfaceVisible(second, false); });
+    passed &= Expect(std::future_status::ready == otherThread.wait_for(std::chrono::seconds(2)), "Another thread was blocked by the open batch");
+    composer.ApplyTransactionBatch();
+    otherThread.wait();
+    passed &= Expect(2 == GetBinderCallCount(), "The concurrent operations were not applied");
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+#include "ATouchEvent.h"
+
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Drives ATouchEvent through uinput devices created after it started, so they arrive through hotplug.
+// Needs write access to /dev/uinput, ctest reports the test as skipped without it.
+
+namespace
+{
+    constexpr int SkipExitCode = 77;
+
+    struct UinputDevice
+    {
+        int fd = -1;
+
+        ~UinputDevice()
+        {
+            if (-1 == fd)
+                return;
+
+            ioctl(fd, UI_DEV_DESTROY);
+            close(fd);
+        }
+
+        void Emit(uint16_t type, uint16_t code, int32_t value) const
+        {
+            input_event event{};
+
+            event.type = type;
+            event.code = code;
+            event.value = value;
+            if (sizeof(event) != write(fd, &event, sizeof(event)))
+                fprintf(stderr, "[-] uinput write failed: %s\n", strerror(errno));
+        }
+    };
+
+    bool SetupAxis(int fd, uint16_t code, int32_t minimum, int32_t maximum)
+    {
+        uinput_abs_setup axis{};
+
+        axis.code = code;
+        axis.absinfo.minimum = minimum;
+        axis.absinfo.maximum = maximum;
+
+        return 0 == ioctl(fd, UI_SET_ABSBIT, code) && 0 == ioctl(fd, UI_ABS_SETUP, &axis);
+    }
+
+    bool CreateDevice(UinputDevice &device, const char *name, bool touch)
+    {
+        uinput_setup setup{};
+
+        device.fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (-1 == device.fd)
+            return false;
+
+        bool result = 0 == ioctl(device.fd, UI_SET_EVBIT, EV_SYN) && 0 == ioctl(device.fd, UI_SET_EVBIT, EV_KEY);
+        if (touch)
+        {
+            result = result && 0 == ioctl(device.fd, UI_SET_EVBIT, EV_ABS) && 0 == ioctl(device.fd, UI_SET_KEYBIT, BTN_TOUCH) && 0 == ioctl(device.fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT);
+            result = result && SetupAxis(device.fd, ABS_MT_SLOT, 0, 9) && SetupAxis(device.fd, ABS_MT_TRACKING_ID, 0, 65535);
+            result = result && SetupAxis(device.fd, ABS_MT_POSITION_X, 0, 1079) && SetupAxis(device.fd, ABS_MT_POSITION_Y, 0, 2399);
+        }
+        else
+            result = result && 0 == ioctl(device.fd, UI_SET_KEYBIT, KEY_A);
+
+        snprintf(setup.name, sizeof(setup.name), "%s", name);
+        setup.id.bustype = BUS_VIRTUAL;
+
+        return result && 0 == ioctl(device.fd, UI_DEV_SETUP, &setup) && 0 == ioctl(device.fd, UI_DEV_CREATE);
+    }
+
+    // Let the reader see the new device node before anything is emitted on it
+    void PumpHotplug(android::ATouchEvent &touchEvent)
+    {
+        android::ATouchEvent::TouchEvent event{};
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+
+        while (std::chrono::steady_clock::now() < deadline)
+            touchEvent.WaitTouchEvent(&event, 50);
+    }
+
+    std::vector<android::ATouchEvent::TouchEvent> CollectEvents(android::ATouchEvent &touchEvent, size_t count)
+    {
+        std::vector<android::ATouchEvent::TouchEvent> result;
+        android::ATouchEvent::TouchEvent event{};
+
+        while (result.size() < count && touchEvent.WaitTouchEvent(&event, 1000))
+            result.push_back(event);
+
+        return result;
+    }
+
+    bool Expect(bool condition, const char *message)
+    {
+        if (!condition)
+            fprintf(stderr, "[-] %s\n", message);
+
+        return condition;
+    }
+}
+
+int main()
+{
+    if (0 != access("/dev/uinput", W_OK))
+    {
+        printf("[=] /dev/uinput is not writable, skipping\n");
+        return SkipExitCode;
+    }
+
+    android::ATouchEvent touchEvent;
+    bool passed = true;
+
+    {
+        UinputDevice touchScreen;
+        if (!CreateDevice(touchScreen, "AImGui host test touch", true))
+        {
+            printf("[=] Could not create a uinput device: %s, skipping\n", strerror(errno));
+            return SkipExitCode;
+        }
+        PumpHotplug(touchEvent);
+
+        touchScreen.Emit(EV_ABS, ABS_MT_SLOT, 0);
+        touchScreen.Emit(EV_ABS, ABS_MT_TRACKING_ID, 1);
+        touchScreen.Emit(EV_ABS, ABS_MT_POSITION_X, 100);
+        touchScreen.Emit(EV_ABS, ABS_MT_POSITION_Y, 200);
+        touchScreen.Emit(EV_KEY, BTN_TOUCH, 1);
+        touchScreen.Emit(EV_SYN, SYN_REPORT, 0);
+        touchScreen.Emit(EV_ABS, ABS_MT_POSITION_X, 150);
+        touchScreen.Emit(EV_SYN, SYN_REPORT, 0);
+        touchScreen.Emit(EV_ABS, ABS_MT_TRACKING_ID, -1);
+        touchScreen.Emit(EV_KEY, BTN_TOUCH, 0);
+        touchScreen.Emit(EV_SYN, SYN_REPORT, 0);
+
+        auto events = CollectEvents(touchEvent, 3);
+        passed &= Expect(3 == events.size(), "The touch device was not picked up through hotplug");
+        if (3 == events.size())
+        {
+            passed &= Expect(android::ATouchEvent::EventType::TouchDown == events[0].type, "The first report is not a touch down");
+            passed &= Expect(android::ATouchEvent::EventType::Move == events[1].type && events[1].x > events[0].x, "The second report is not a move to the right");
+            passed &= Expect(android::ATouchEvent::EventType::TouchUp == events[2].type, "The last report is not a touch up");
+            passed &= Expect(0 < events[0].timestampNanoseconds, "The report carries no kernel timestamp");
+        }
+    }
+
+    // The touch screen is gone, a keyboard plugged in now must be read by the same epoll set
+    {
+        UinputDevice keyboard;
+        if (!CreateDevice(keyboard, "AImGui host test keyboard", false))
+        {
+            printf("[=] Could not create a uinput device: %s, skipping\n", strerror(errno));
+            return SkipExitCode;
+        }
+        PumpHotplug(touchEvent);
+
+        keyboard.Emit(EV_KEY, KEY_A, 1);
+        keyboard.Emit(EV_SYN, SYN_REPORT, 0);
+        keyboard.Emit(EV_KEY, KEY_A, 0);
+        keyboard.Emit(EV_SYN, SYN_REPORT, 0);
+
+        auto events = CollectEvents(touchEvent, 2);
+        passed &= Expect(2 == events.size(), "The keyboard was not picked up through hotplug");
+        if (2 == events.size())
+        {
+            passed &= Expect(android::ATouchEvent::EventType::KeyDown == events[0].type && KEY_A == events[0].scanCode, "The key press was not reported");
+            passed &= Expect(android::ATouchEvent::EventType::KeyUp == events[1].type && KEY_A == events[1].scanCode, "The key release was not reported");
+        }
+    }
+
+    printf("[=] uinput touch and keyboard hotplug %s\n", passed ? "passed" : "failed");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
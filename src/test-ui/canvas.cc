@@ -19,8 +19,7 @@ int main()
         {
             while (imgui)
             {
-                imgui.ProcessInputEvent();
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
+                imgui.WaitInputEvent();
             }
         });
 
@@ -31,6 +30,7 @@ int main()
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
+    imgui.InterruptInputEvent();
     if (processInputEventThread.joinable())
         processInputEventThread.join();
 
@@ -21,8 +21,7 @@ int main()
         {
             while (state)
             {
-                imgui.ProcessInputEvent();
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
+                imgui.WaitInputEvent();
             }
         });
 
@@ -71,6 +70,7 @@ int main()
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
+    imgui.InterruptInputEvent();
     if (processInputEventThread.joinable())
         processInputEventThread.join();
 